@@ -3,8 +3,16 @@
 mkdir -p build
 
 CC=gcc
+CXX=g++
 CFLAGS="-std=c11 -Wall -Wextra -O2 -Isrc -D_GNU_SOURCE"
+CXXFLAGS="-std=c++17 -Wall -Wextra -O2 -Isrc -D_GNU_SOURCE"
 LDLIBS="-lpthread"
+# SIZE_CLASSES=<header> ./scripts/build_tests.sh, to match a library built with `make SIZE_CLASSES=<header>`
+if [ -n "$SIZE_CLASSES" ]; then
+    CFLAGS="$CFLAGS -DTKMALLOC_SIZE_CLASSES=\"$(realpath "$SIZE_CLASSES")\""
+fi
+# tests of the tkmalloc_* API link against the library directly
+TKLIBS="-Lbuild -ltkmalloc -Wl,-rpath,\$ORIGIN"
 
 echo "Building test binaries..."
 
@@ -17,6 +25,48 @@ echo "  [Done] build/sequential"
 $CC $CFLAGS tests/parallel.c -o build/parallel $LDLIBS -fopenmp
 echo "  [Done] build/parallel (OpenMP enabled)"
 
+$CC $CFLAGS tests/arena.c -o build/arena $TKLIBS $LDLIBS
+echo "  [Done] build/arena"
+
+$CC $CFLAGS tests/batch.c -o build/batch $TKLIBS $LDLIBS -fopenmp
+echo "  [Done] build/batch"
+
+$CC $CFLAGS tests/numa.c -o build/numa $TKLIBS $LDLIBS -fopenmp
+echo "  [Done] build/numa"
+
+$CC $CFLAGS tests/quicklist.c -o build/quicklist $TKLIBS $LDLIBS
+echo "  [Done] build/quicklist"
+
+$CC $CFLAGS tests/heaps.c -o build/heaps $TKLIBS $LDLIBS
+echo "  [Done] build/heaps"
+
+$CC $CFLAGS tests/pressure.c -o build/pressure $TKLIBS $LDLIBS
+echo "  [Done] build/pressure"
+
+$CC $CFLAGS tests/size_classes.c -o build/size_classes $LDLIBS
+echo "  [Done] build/size_classes"
+
+$CC $CFLAGS tests/lazy.c -o build/lazy $TKLIBS $LDLIBS
+echo "  [Done] build/lazy"
+
+$CC $CFLAGS tests/tlab.c -o build/tlab $TKLIBS $LDLIBS
+echo "  [Done] build/tlab"
+
+$CC $CFLAGS tests/latency.c -o build/latency $TKLIBS $LDLIBS
+echo "  [Done] build/latency"
+
+$CC $CFLAGS tests/latency_mode.c -o build/latency_mode $TKLIBS $LDLIBS
+echo "  [Done] build/latency_mode"
+
+$CC $CFLAGS tests/shm.c -o build/shm $TKLIBS $LDLIBS
+echo "  [Done] build/shm"
+
+$CC $CFLAGS tests/pheap.c -o build/pheap $TKLIBS $LDLIBS
+echo "  [Done] build/pheap"
+
+$CXX $CXXFLAGS tests/new.cpp -o build/new $TKLIBS $LDLIBS
+echo "  [Done] build/new"
+
 echo ""
 echo "Compilation complete. To run with your allocator, use:"
 echo "LD_PRELOAD=./build/libtkmalloc.so ./build/hello"
@@ -26,7 +76,7 @@ echo "To check that the symbol has been injected, set TKMALLOC_INJECTED environm
 echo "TKMALLOC_INJECTED=1 LD_PRELOAD=./build/libtkmalloc.so ./build/hello"
 
 echo ""
-echo "To enable logging, set TKMALLOC_VERBOSE environment variable:"
+echo "To enable logging, build the library with \`make DEBUG=1\` and set TKMALLOC_VERBOSE environment variable:"
 echo "TKMALLOC_VERBOSE=1 LD_PRELOAD=./build/libtkmalloc.so ./build/hello"
 
 echo ""
@@ -4,13 +4,32 @@
 #include "arena.h"
 #include "util.h"
 #include "config.h"
+#include "latency.h"
+#include "numa.h"
+#include "freelist.h"
+#include "percpu.h"
+#include "pressure.h"
+#include "tlab.h"
+#include "trace.h"
+#include "warm.h"
 
 static pthread_once_t g_once = PTHREAD_ONCE_INIT;
-static arena_t g_arenas[MAX_NUM_ARENAS];
+static arena_t g_arenas[MAX_NUM_ARENAS];     // set up by global_init(), each one's first heap is mapped lazily
+
+// serves allocations global_init() itself makes (e.g. from libc), which can't wait on g_once;
+// its one heap lives in .bss, so it never gets a second heap and is never unmapped
+static arena_t g_bootstrap_arena;
+static uint8_t g_bootstrap_mem[ARENA_BOOTSTRAP_HEAP_SIZE] __attribute__((aligned(64)));
+static _Thread_local int t_in_global_init = 0;
 static int g_num_arenas = 0;
 static int g_next_arena = 0;
 static pthread_mutex_t g_arena_assign_lock = PTHREAD_MUTEX_INITIALIZER;
 
+// arenas are laid out node by node: node n owns g_arenas[first .. first + num)
+static int g_node_first_arena[NUMA_MAX_NODES];
+static int g_node_num_arenas[NUMA_MAX_NODES];
+static int g_node_next_arena[NUMA_MAX_NODES];
+
 // If compiled with a specific C standard, the compiler defines __STDC_VERSION__
 #if __STDC_VERSION__ >= 201112L
     static _Thread_local arena_t *t_arena = NULL;
@@ -18,12 +37,18 @@ static pthread_mutex_t g_arena_assign_lock = PTHREAD_MUTEX_INITIALIZER;
     static __thread arena_t *t_arena = NULL;
 #endif
 
-int arena_map_new_heap(arena_t *a, size_t need_total) {
-    size_t req = align_pagesize(need_total);
-
+/* map and set up a heap of req bytes for a, without linking it in */
+static heap_t *arena_mmap_heap(arena_t *a, size_t req) {
     void *mem = mmap(NULL, req, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-    if (mem == MAP_FAILED) return -1;
+    if (mem == MAP_FAILED) return NULL;
+
+    pressure_account(req, 1);
+
+    numa_bind(mem, req, a->node);  // must happen before the heap header below first-touches the mapping
+
+    // so is prefaulting, which is also why it isn't done with MAP_POPULATE
+    if (g_cfg.latency_mode || g_cfg.lock_heaps) warm_heap_memory(mem, req);
 
     heap_t *h = (heap_t *)mem;
     h->arena = a;
@@ -34,6 +59,38 @@ int arena_map_new_heap(arena_t *a, size_t need_total) {
     h->base = payload;
     h->bump = h->base;
     h->end = (uint8_t *)mem + req;
+    h->used = 0;
+    h->draining = 0;
+
+    return h;
+}
+
+static void arena_munmap_heap(heap_t *h) {
+    size_t map_size = (size_t)((uint8_t *)h->end - (uint8_t *)h);
+    TRACE2(heap_unmap, h, map_size);
+    (void)munmap((void *)h, map_size);
+    pressure_account(map_size, 0);
+}
+
+int arena_map_new_heap(arena_t *a, size_t need_total) {
+    if (a->id == ARENA_BOOTSTRAP_ID) return -1;
+
+    size_t req = align_pagesize(need_total);
+    heap_t *h = NULL;
+
+    // the spare is already mapped and counted, so it is taken even over the soft limit
+    if (a->spare && a->heaps && req <= (size_t)(a->spare->end - (uint8_t *)a->spare)) {
+        h = a->spare;
+        a->spare = NULL;
+        warm_request();     // have the next one ready before this one fills up
+    }
+    else {
+        // an arena's first heap is always mapped; past that, a heap over the soft limit fails like mmap would
+        if (a->heaps && !pressure_may_map(req)) return -1;
+
+        h = arena_mmap_heap(a, req);
+        if (!h) return -1;
+    }
 
     if (a->heaps == NULL) {
         a->heaps = h;
@@ -46,6 +103,59 @@ int arena_map_new_heap(arena_t *a, size_t need_total) {
 
     a->active_heap = h;
 
+    TRACE2(heap_map, h, (size_t)(h->end - (uint8_t *)h));
+    return 0;
+}
+
+int arena_fill_spare(arena_t *a) {
+    pthread_mutex_lock(&a->lock);
+    int want = __atomic_load_n(&a->ready, __ATOMIC_RELAXED) && a->spare == NULL;
+    pthread_mutex_unlock(&a->lock);
+
+    // a spare past the high-water mark would only be trimmed again by the relief its mapping asks for
+    if (!want || !pressure_may_map_spare(ARENA_DEFAULT_HEAP_SIZE)) return 0;
+
+    // prefaulting 16 MiB takes milliseconds, far too long to hold the lock for
+    heap_t *h = arena_mmap_heap(a, ARENA_DEFAULT_HEAP_SIZE);
+    if (!h) return 0;
+
+    pthread_mutex_lock(&a->lock);
+    if (a->spare == NULL) {
+        a->spare = h;
+        h = NULL;
+    }
+    pthread_mutex_unlock(&a->lock);
+
+    if (h) arena_munmap_heap(h);
+    return h == NULL;
+}
+
+/* the fullest heap with room for need_total bytes at its bump, preferring heaps that aren't draining; NULL if none */
+heap_t *arena_pick_heap(arena_t *a, size_t need_total) {
+    heap_t *best = NULL;
+    heap_t *best_draining = NULL;
+
+    // packing new chunks into the fullest heaps lets the emptier ones drain and be unmapped
+    for (heap_t *h = a->heaps; h; h = h->next) {
+        if (!heap_has_room(h, need_total)) continue;
+
+        heap_t **slot = h->draining ? &best_draining : &best;
+        if (!*slot || h->used > (*slot)->used) *slot = h;
+    }
+
+    // reusing a draining heap still beats mapping a new one
+    if (!best && best_draining) {
+        best_draining->draining = 0;
+        best = best_draining;
+    }
+
+    return best;
+}
+
+int arena_has_room(arena_t *a, size_t need_total) {
+    for (heap_t *h = a->heaps; h; h = h->next) {
+        if (heap_has_room(h, need_total)) return 1;
+    }
     return 0;
 }
 
@@ -65,12 +175,13 @@ int arena_unmap_heap(arena_t *a, heap_t *h) {
             }
             
             if (h == a->active_heap) {
-                // for now, we always set the last heap to be the active heap
-                a->active_heap = prev;
+                // any heap will do; carving moves on to the fullest one once this one fills up.
+                // It can't stay draining while it is carved from
+                a->active_heap = a->heaps;
+                if (a->active_heap) a->active_heap->draining = 0;
             }
 
-            size_t map_size = (size_t)((uint8_t *)h->end - (uint8_t *)h);
-            (void)munmap((void *)h, map_size);
+            arena_munmap_heap(h);
             return 0;
         }
         prev = curr;
@@ -79,57 +190,197 @@ int arena_unmap_heap(arena_t *a, heap_t *h) {
     return -1;
 }
 
-static void arena_unmap_all_heaps(arena_t *a) {
+void arena_unmap_all_heaps(arena_t *a) {
     heap_t *h = a->heaps;
 
     while (h) {
         heap_t *next = h->next;
-        size_t map_size = (size_t)((uint8_t *)h->end - (uint8_t *)h);
-        (void)munmap((void *)h, map_size);
+        arena_munmap_heap(h);
         h = next;
     }
+
+    if (a->spare) arena_munmap_heap(a->spare);
     
     a->heaps = NULL;
     a->active_heap = NULL;
+    a->spare = NULL;
+}
+
+/* hand the pages in [lo, hi) back to the OS, if the range covers any whole page */
+static size_t arena_purge_range(uint8_t *lo, uint8_t *hi) {
+    size_t ps = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)lo + ps - 1) & ~(uintptr_t)(ps - 1);
+    uintptr_t stop = (uintptr_t)hi & ~(uintptr_t)(ps - 1);
+
+    if (stop <= start) return 0;
+
+    // mlocked heaps (TKMALLOC_LOCK_HEAPS) refuse MADV_DONTNEED with EINVAL and keep their pages
+    if (madvise((void *)start, stop - start, MADV_DONTNEED) != 0) return 0;
+    return stop - start;
+}
+
+/* under memory pressure: drop the spare heap, merge the quick lists, then release the pages of free chunks and of every heap's unused top */
+size_t arena_trim(arena_t *a) {
+    size_t purged = 0;
+
+    pthread_mutex_lock(&a->lock);
+
+    if (a->spare) {
+        purged += (size_t)(a->spare->end - (uint8_t *)a->spare);
+        arena_munmap_heap(a->spare);
+        a->spare = NULL;
+    }
+
+    if (a->quick_bytes > 0) quick_list_consolidate(a);
+
+    // a free chunk's links and footer must survive, only the pages in between go
+    for (free_chunk_t *fc = a->free_list; fc; fc = fc->prev) {
+        if (!chunk_is_free(fc)) continue;
+
+        uint8_t *p = (uint8_t *)fc;
+        purged += arena_purge_range(p + sizeof(free_chunk_t), p + chunk_get_size(fc) - sizeof(size_t));
+    }
+
+    for (heap_t *h = a->heaps; h; h = h->next) {
+        purged += arena_purge_range(h->bump, h->end);
+    }
+
+    pthread_mutex_unlock(&a->lock);
+
+    return purged;
 }
 
-static int arena_init(arena_t *a, int id) {
+/* everything but the heaps */
+static void arena_setup(arena_t *a, int id, int node) {
     a->id = id;
+    a->node = node;
+    a->ready = 0;
     a->heaps = NULL;
     a->active_heap = NULL;
+    a->spare = NULL;
     a->free_list = NULL;
+    for (int i = 0; i < QUICK_NUM_BINS; ++i) a->quick[i] = NULL;
+    a->quick_bytes = 0;
+    a->quick_hits = a->quick_frees = a->quick_consolidations = a->quick_consolidated = 0;
     pthread_mutex_init(&a->lock, NULL);
+}
+
+/* set up an arena and map its first heap of ARENA_DEFAULT_HEAP_SIZE */
+int arena_init(arena_t *a, int id, int node) {
+    arena_setup(a, id, node);
 
     int add_heap_succeeded = arena_map_new_heap(a, ARENA_DEFAULT_HEAP_SIZE);
     if (add_heap_succeeded < 0) return -1;
 
+    a->ready = 1;
     return 0;
 }
 
+static void arena_bootstrap_init(void) {
+    arena_setup(&g_bootstrap_arena, ARENA_BOOTSTRAP_ID, NUMA_NO_NODE);
+
+    heap_t *h = (heap_t *)g_bootstrap_mem;
+    h->arena = &g_bootstrap_arena;
+    h->next = NULL;
+    h->base = g_bootstrap_mem + sizeof(*h);
+    h->bump = h->base;
+    h->end = g_bootstrap_mem + sizeof(g_bootstrap_mem);
+    h->used = 0;
+    h->draining = 0;
+
+    g_bootstrap_arena.heaps = h;
+    g_bootstrap_arena.active_heap = h;
+    g_bootstrap_arena.ready = 1;
+}
+
 /* for malloc, we want to allocate from the thread-specific arena */
 arena_t *arena_from_thread(void) {
     if (t_arena) return t_arena;
 
+    if (t_in_global_init) return &g_bootstrap_arena;
+
+    pthread_mutex_lock(&g_arena_assign_lock);
+
+    // the thread may migrate later, but first touch and most of its life are likely spent on this node
+    int node = numa_current_node();
+    int idx;
+
     if (g_cfg.disable_arenas) {
-        t_arena = &g_arenas[0];
-        return t_arena;
+        idx = 0;
+    }
+    else if (g_node_num_arenas[node] > 0) {
+        idx = g_node_first_arena[node] + g_node_next_arena[node] % g_node_num_arenas[node];
+        g_node_next_arena[node]++;
+    }
+    else {
+        // e.g. a CPU that wasn't listed in the topology
+        idx = g_next_arena % g_num_arenas;
+        g_next_arena++;
     }
 
-    pthread_mutex_lock(&g_arena_assign_lock);
+    arena_t *a = &g_arenas[idx];
+
+    // the first thread assigned to an arena maps its heap, small: most processes never fill it.
+    // a->lock as well, since trims, stats and the spare heap thread walk the heaps and read ready under it
+    if (!a->ready) {
+        pthread_mutex_lock(&a->lock);
+        int mapped = arena_map_new_heap(a, ARENA_INITIAL_HEAP_SIZE) == 0;
+        if (mapped) __atomic_store_n(&a->ready, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&a->lock);
 
-    int idx = g_next_arena % g_num_arenas;
-    g_next_arena++;
+        if (mapped) warm_request();
+    }
 
-    t_arena = &g_arenas[idx];
+    if (a->ready) t_arena = a;
 
     pthread_mutex_unlock(&g_arena_assign_lock);
 
     return t_arena;
 }
 
+arena_t *arena_of_thread(void) {
+    return t_arena;
+}
+
+/* split g_num_arenas across nodes in proportion to their CPU counts */
+static void arena_layout_nodes(void) {
+    int total_cpus = 0;
+    for (int n = 0; n < g_numa.num_nodes; ++n) total_cpus += g_numa.cpus_per_node[n];
+
+    if (g_numa.num_nodes <= 1 || total_cpus == 0) {
+        g_node_first_arena[0] = 0;
+        g_node_num_arenas[0] = g_num_arenas;
+        return;
+    }
+
+    int next = 0;
+
+    for (int n = 0; n < g_numa.num_nodes; ++n) {
+        int want = g_numa.cpus_per_node[n] * g_num_arenas / total_cpus;
+
+        if (g_numa.cpus_per_node[n] > 0 && want < 1) want = 1;
+        if (next + want > MAX_NUM_ARENAS) want = MAX_NUM_ARENAS - next;
+
+        g_node_first_arena[n] = next;
+        g_node_num_arenas[n] = want;
+        next += want;
+    }
+
+    g_num_arenas = next;
+}
+
 static void global_init(void) {
+    t_in_global_init = 1;
+    arena_bootstrap_init();
+
     config_init();  // read environment variables once during startup
 
+    (void)percpu_init();    // on failure g_percpu stays NULL and the per-thread tcache is used
+
+    latency_init();
+
+    if (!g_cfg.disable_tlab) tlab_init();
+
     if (g_cfg.disable_arenas) {
         g_num_arenas = 1;
     }
@@ -145,17 +396,48 @@ static void global_init(void) {
     
     if (g_num_arenas > MAX_NUM_ARENAS) g_num_arenas = MAX_NUM_ARENAS;
 
+    if (!g_cfg.disable_arenas && !g_cfg.disable_numa) {
+        numa_init(g_cfg.numa_sysfs_root);
+    }
+
+    arena_layout_nodes();
+
     for (int i = 0; i < g_num_arenas; ++i) {
-        if (arena_init(&g_arenas[i], i) < 0) {
-            // clean up if arena_init fails
-            for (int j = 0; j < i; ++j) {
-                arena_unmap_all_heaps(&g_arenas[j]);
+        int node = NUMA_NO_NODE;
+
+        if (g_numa.num_nodes > 1) {
+            for (int n = 0; n < g_numa.num_nodes; ++n) {
+                if (i >= g_node_first_arena[n] && i < g_node_first_arena[n] + g_node_num_arenas[n]) node = n;
             }
-            return;
         }
+
+        arena_setup(&g_arenas[i], i, node);     // heaps come later, see arena_from_thread()
     }
+
+    if (g_cfg.latency_mode) warm_init();    // after the arenas: its thread walks them
+
+    t_in_global_init = 0;
+}
+
+int arena_count(void) {
+    return g_num_arenas;
+}
+
+arena_t *arena_at(int idx) {
+    return (idx >= 0 && idx < g_num_arenas) ? &g_arenas[idx] : NULL;
+}
+
+void arena_lock_all(void) {
+    pthread_mutex_lock(&g_arena_assign_lock);
+    for (int i = 0; i < g_num_arenas; i++) pthread_mutex_lock(&g_arenas[i].lock);
+}
+
+void arena_unlock_all(void) {
+    for (int i = g_num_arenas - 1; i >= 0; i--) pthread_mutex_unlock(&g_arenas[i].lock);
+    pthread_mutex_unlock(&g_arena_assign_lock);
 }
 
 void ensure_global_init(void) {
+    if (t_in_global_init) return;   // global_init() allocating: arena_from_thread() hands out the bootstrap arena
     pthread_once(&g_once, global_init);
 }
@@ -7,23 +7,81 @@
 
 #define MAX_NUM_ARENAS 64
 #define ARENA_DEFAULT_HEAP_SIZE (size_t) 16 * 1024 * 1024
+#define ARENA_INITIAL_HEAP_SIZE (size_t) 256 * 1024       // first heap of a global arena, mapped when a thread is first assigned to it
+#define ARENA_BOOTSTRAP_HEAP_SIZE (size_t) 64 * 1024      // static heap for allocations made while global_init() runs
+#define ARENA_BOOTSTRAP_ID -2
+
+/*
+ * Quick lists: mid-size chunks freed past the tcache are parked here unmerged, one exact-size list per
+ * 16-byte class (like glibc fastbins). They stay "in use" from the heap's point of view, so no boundary
+ * tags are written; they are coalesced in bulk when an allocation misses or quick_bytes passes the threshold.
+ */
+#define QUICK_MIN_SIZE 32
+#define QUICK_MAX_SIZE 4096
+#define QUICK_NUM_BINS ((QUICK_MAX_SIZE - QUICK_MIN_SIZE) / 16 + 1)
+#define QUICK_CONSOLIDATE_BYTES (size_t)(256 * 1024)
 
 typedef struct arena {
     int id;
+    int node;               // dense NUMA node index the heaps are bound to, NUMA_NO_NODE for no binding
+    int ready;              // global arenas: first heap mapped; set once, under the assignment lock and a->lock
     heap_t *heaps;
-    heap_t *active_heap;    // for now, let's assume that the active_heap is always the heap that was most recently added
+    heap_t *active_heap;    // heap we carve from; when it fills up we move to the fullest heap that still has room
+    heap_t *spare;          // latency mode: a prefaulted heap, not yet linked, that the next new heap is taken from
     free_chunk_t *free_list;
+    free_chunk_t *quick[QUICK_NUM_BINS];
+    size_t quick_bytes;                 // bytes parked in the quick lists
+    uint64_t quick_hits;                // allocations served by a quick list: one merge and one split avoided each
+    uint64_t quick_frees;               // frees parked unmerged
+    uint64_t quick_consolidations;
+    uint64_t quick_consolidated;        // chunks merged by consolidations (quick_frees - quick_consolidated were reused as is)
     pthread_mutex_t lock;
 } arena_t;
 
+/* bytes to map for a heap that must hold at least one chunk of need_total bytes */
+static inline size_t arena_heap_map_size(size_t need_total) {
+    size_t req = need_total + sizeof(heap_t) + 16;     // heap header + worst-case payload alignment
+    return req < ARENA_DEFAULT_HEAP_SIZE ? ARENA_DEFAULT_HEAP_SIZE : req;
+}
+
+/* set up an arena and map its first heap of ARENA_DEFAULT_HEAP_SIZE */
+int arena_init(arena_t *a, int id, int node);
+
 int arena_map_new_heap(arena_t *a, size_t need_total);
 
+/* latency mode: map a prefaulted spare heap for a ready arena that has none (called without a->lock); 1 if one was added */
+int arena_fill_spare(arena_t *a);
+
+/* the fullest heap with room for need_total bytes at its bump, preferring heaps that aren't draining; NULL if none */
+heap_t *arena_pick_heap(arena_t *a, size_t need_total);
+
+/* whether any heap has room for need_total bytes at its bump, i.e. carving them wouldn't map a new heap */
+int arena_has_room(arena_t *a, size_t need_total);
+
 /* find heap and remove from the linked list*/
 int arena_unmap_heap(arena_t *a, heap_t *h);
 
-/* for malloc, we want to allocate from the thread-specific arena */
+void arena_unmap_all_heaps(arena_t *a);
+
+/* under memory pressure: merge the quick lists, then release the pages of free chunks and of every heap's unused top */
+size_t arena_trim(arena_t *a);
+
+/* for malloc, we want to allocate from the thread-specific arena, preferably one on the caller's NUMA node */
 arena_t *arena_from_thread(void);
 
+/* the arena the calling thread was assigned, NULL if it hasn't allocated yet; never assigns one */
+arena_t *arena_of_thread(void);
+
+/* the global arenas, e.g. to walk them for statistics */
+int arena_count(void);
+
+arena_t *arena_at(int idx);
+
+/* around fork(): hold the assignment lock and every arena's lock, so the child can't inherit one mid-update */
+void arena_lock_all(void);
+
+void arena_unlock_all(void);
+
 void ensure_global_init(void);
 
 #endif
\ No newline at end of file
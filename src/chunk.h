@@ -5,6 +5,13 @@
 #include <stdint.h>     // uint8_t
 #include "util.h"       // align_16
 
+// cache size classes: the built-in linear ladder, or a table from tools/gen_size_classes (make SIZE_CLASSES=<header>)
+#ifdef TKMALLOC_SIZE_CLASSES
+#include TKMALLOC_SIZE_CLASSES
+#else
+#include "size_classes.h"
+#endif
+
 /* 
  * In-use:    [ header (size | flags) ]       8 bytes (in a 64 bit machine), the last four bits are flags
  *            [ owning heap ptr       ]       8 bytes
@@ -19,6 +26,7 @@
  * 
  * flags: 
  *    - bit 0: PREV_IN_USE_BIT (P)
+ *    - bit 1: TLAB_BIT (T), the unused rest of a thread's allocation buffer (see tlab.h)
  * 
  * Note: the reason why we can store the chunk size and the flags in a single header is because the chunk size is 16 aligned in a 64-bit machine.
  * This means that the low four bits of the chunk size will always be zero - so we can use these bits to store metadata.
@@ -59,6 +67,13 @@ typedef struct free_chunk {
  */
 #define CHUNK_HDR_P_MASK ((size_t) 1)
 
+/*
+ * TLAB_BIT marks the header of a TLAB remainder. Its owning thread rewrites that header without the arena lock
+ * whenever it carves a chunk off the front, so everyone else must treat it as in use, and update its P bit
+ * atomically instead of with a plain read-modify-write.
+ */
+#define CHUNK_HDR_TLAB_MASK ((size_t) 2)
+
 static inline int chunk_get_P(size_t hdr_word) { return (hdr_word & CHUNK_HDR_P_MASK) != 0; }   // hdr_word differentiated from size_t* hdr
 
 static inline void chunk_set_P(void *hdr, int on) {
@@ -91,7 +106,18 @@ static inline size_t chunk_get_size(void *hdr) {
 }
 
 static inline int prev_chunk_is_free(void *hdr) { 
-    return !chunk_get_P(*(size_t*)hdr); 
+    return !chunk_get_P(__atomic_load_n((size_t*)hdr, __ATOMIC_RELAXED));     // hdr may be a TLAB remainder
+}
+
+/* acquire: once a TLAB chunk is seen published, its header and the remainder header after it are visible */
+static inline int chunk_is_tlab(void *hdr) {
+    return (__atomic_load_n((size_t*)hdr, __ATOMIC_ACQUIRE) & CHUNK_HDR_TLAB_MASK) != 0;
+}
+
+/* chunk_set_P for a header that may be a TLAB remainder, racing with its owner */
+static inline void chunk_set_P_atomic(void *hdr, int on) {
+    if (on) __atomic_fetch_or((size_t*)hdr, CHUNK_HDR_P_MASK, __ATOMIC_RELAXED);
+    else __atomic_fetch_and((size_t*)hdr, ~CHUNK_HDR_P_MASK, __ATOMIC_RELAXED);
 }
 
 static inline void* get_next_chunk_hdr(void *hdr) { 
@@ -115,4 +141,16 @@ static inline size_t get_free_chunk_min_size(void) {
     return align_16(sizeof(free_chunk_t) + sizeof(size_t)); 
 }
 
+/* total chunk size (prefix + payload) needed to serve a request of `size` bytes, rounded up to its size class */
+static inline size_t chunk_need_total(size_t size) {
+    size_t need_total = align_16(sizeof(chunk_prefix_t) + align_16(size));
+    size_t min_chunk = get_free_chunk_min_size();
+    if (need_total < min_chunk) need_total = min_chunk;
+
+    // every chunk of a class is at least the class size, so any of them can serve any request of the class
+    if (need_total <= SIZE_CLASS_MAX) need_total = g_size_class_size[g_size_class_ceil[need_total / 16]];
+
+    return need_total;
+}
+
 #endif
\ No newline at end of file
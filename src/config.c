@@ -5,6 +5,25 @@
 
 tkmalloc_config_t g_cfg = {0};  // zero-initializes env var
 
+/* "512M", "2g", "1048576": a byte count with an optional K / M / G suffix; 0 if malformed */
+static size_t parse_size(const char *s) {
+    size_t n = 0;
+    const char *p = s;
+
+    for (; *p >= '0' && *p <= '9'; ++p) n = n * 10 + (size_t)(*p - '0');
+    if (p == s) return 0;
+
+    switch (*p) {
+        case '\0': return n;
+        case 'k': case 'K': n <<= 10; break;
+        case 'm': case 'M': n <<= 20; break;
+        case 'g': case 'G': n <<= 30; break;
+        default: return 0;
+    }
+
+    return p[1] == '\0' ? n : 0;
+}
+
 void config_init(void) {
     if (getenv("TKMALLOC_INJECTED")) {
         char* msg = "WARNING! You are using tkmalloc.\n";
@@ -13,9 +32,13 @@ void config_init(void) {
     }
 
     if (getenv("TKMALLOC_VERBOSE")) {
+#ifdef TKMALLOC_DEBUG
         char* msg = "Logs enabled.\n";
-        ignore_write_result(write(1, msg, safe_strlen(msg)));
         g_cfg.verbose = 1;
+#else
+        char* msg = "Logs are compiled out, rebuild with `make DEBUG=1` to enable them.\n";
+#endif
+        ignore_write_result(write(1, msg, safe_strlen(msg)));
     }
     
     if (getenv("TKMALLOC_DISABLE_ARENAS")) {
@@ -33,4 +56,64 @@ void config_init(void) {
         }
         g_cfg.disable_tcache = 1;
     }
+
+    if (getenv("TKMALLOC_DISABLE_PERCPU")) {
+        if (g_cfg.verbose) {
+            char* msg = "Per-CPU caches disabled, using per-thread tcache.\n";
+            ignore_write_result(write(1, msg, safe_strlen(msg)));
+        }
+        g_cfg.disable_percpu = 1;
+    }
+
+    if (getenv("TKMALLOC_DISABLE_QUICKLIST")) {
+        if (g_cfg.verbose) {
+            char* msg = "Quick lists disabled, every free coalesces.\n";
+            ignore_write_result(write(1, msg, safe_strlen(msg)));
+        }
+        g_cfg.disable_quicklist = 1;
+    }
+
+    if (getenv("TKMALLOC_DISABLE_NUMA")) {
+        if (g_cfg.verbose) {
+            char* msg = "NUMA-aware arenas disabled.\n";
+            ignore_write_result(write(1, msg, safe_strlen(msg)));
+        }
+        g_cfg.disable_numa = 1;
+    }
+
+    if (getenv("TKMALLOC_DISABLE_TLAB")) {
+        if (g_cfg.verbose) {
+            char* msg = "Thread-local allocation buffers disabled.\n";
+            ignore_write_result(write(1, msg, safe_strlen(msg)));
+        }
+        g_cfg.disable_tlab = 1;
+    }
+
+    if (getenv("TKMALLOC_LATENCY_MODE")) {
+        if (g_cfg.verbose) {
+            char* msg = "Latency mode: heaps are prefaulted, spare heaps mapped in the background.\n";
+            ignore_write_result(write(1, msg, safe_strlen(msg)));
+        }
+        g_cfg.latency_mode = 1;
+    }
+
+    if (getenv("TKMALLOC_LOCK_HEAPS")) {
+        if (g_cfg.verbose) {
+            char* msg = "Heaps are locked into memory.\n";
+            ignore_write_result(write(1, msg, safe_strlen(msg)));
+        }
+        g_cfg.lock_heaps = 1;
+    }
+
+    const char *limit = getenv("TKMALLOC_SOFT_LIMIT");
+    if (limit) {
+        g_cfg.soft_limit = parse_size(limit);
+        if (g_cfg.verbose) {
+            char* msg = g_cfg.soft_limit ? "Soft memory limit set.\n" : "Malformed TKMALLOC_SOFT_LIMIT, ignored.\n";
+            ignore_write_result(write(1, msg, safe_strlen(msg)));
+        }
+    }
+
+    // lets tests (or containers with a trimmed /sys) feed a fake topology
+    g_cfg.numa_sysfs_root = getenv("TKMALLOC_NUMA_SYSFS_ROOT");
 }
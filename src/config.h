@@ -7,7 +7,15 @@ typedef struct {
     int injected;
     int verbose;
     int disable_tcache;
+    int disable_percpu;
+    int disable_quicklist;
     int disable_arenas;
+    int disable_numa;
+    int disable_tlab;
+    int latency_mode;               // prefault heaps and keep a spare heap ready per arena
+    int lock_heaps;                 // mlock heaps as well
+    const char *numa_sysfs_root;    // NULL means the real /sys topology
+    size_t soft_limit;              // bytes of heaps to stay under, 0 for no limit
 } tkmalloc_config_t;
 
 extern tkmalloc_config_t g_cfg;
@@ -16,6 +16,13 @@ static inline void ignore_write_result(ssize_t result) {
     (void)result;   // casts value to void i.e., we are intentionally not using this value.
 }
 
+/*
+ * Verbose logs are only compiled into debug builds (`make DEBUG=1`); in release builds these are empty,
+ * so the hot path carries no g_cfg.verbose loads or branches. Use the probes in trace.h to observe
+ * release builds.
+ */
+#ifdef TKMALLOC_DEBUG
+
 static inline void safe_log_msg(const char *msg) {
     if (g_cfg.verbose && msg) {
         ignore_write_result(write(1, msg, safe_strlen(msg)));
@@ -43,4 +50,12 @@ static inline void safe_log_ptr(const char *msg, void *ptr) {
     ignore_write_result(write(STDOUT_FILENO, buf, 19));
 }
 
+#else
+
+static inline void safe_log_msg(const char *msg) { (void)msg; }
+
+static inline void safe_log_ptr(const char *msg, void *ptr) { (void)msg; (void)ptr; }
+
+#endif
+
 #endif
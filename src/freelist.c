@@ -1,4 +1,5 @@
 #include "freelist.h"
+#include "config.h"
 #include "debug.h"
 
 void free_list_remove(arena_t *a, free_chunk_t *fc) {
@@ -26,13 +27,104 @@ void free_list_push_front(arena_t *a, free_chunk_t *fc) {
     a->free_list = fc;
 }
 
-void* free_list_try(arena_t *a, size_t need_total) {
+static inline int quick_bin_index(size_t csz) {
+    if (csz < QUICK_MIN_SIZE || csz > QUICK_MAX_SIZE) return -1;
+    return (int)((csz - QUICK_MIN_SIZE) / 16);
+}
+
+int quick_list_push(arena_t *a, void *hdr) {
+    if (g_cfg.disable_quicklist) return 0;
+
+    size_t csz = chunk_get_size(hdr);
+    int bin = quick_bin_index(csz);
+    if (bin < 0) return 0;
+
+    // like the tcache: the chunk stays in use, only its prev link is borrowed
+    free_chunk_t *fc = (free_chunk_t*)hdr;
+    fc->prev = a->quick[bin];
+    a->quick[bin] = fc;
+    a->quick_bytes += csz;
+    a->quick_frees++;
+
+    if (a->quick_bytes > QUICK_CONSOLIDATE_BYTES) {
+        safe_log_msg("[quick_list_push]: too many unmerged bytes, consolidate\n");
+        quick_list_consolidate(a);
+    }
+    return 1;
+}
+
+void quick_list_consolidate(arena_t *a) {
+    if (a->quick_bytes == 0) return;
+
+    a->quick_consolidations++;
+
+    for (int bin = 0; bin < QUICK_NUM_BINS; bin++) {
+        free_chunk_t *fc = a->quick[bin];
+        a->quick[bin] = NULL;
+
+        while (fc) {
+            free_chunk_t *next = fc->prev;
+            // can't unmap a heap that still holds other parked chunks: those are in use, so its bump never reaches base
+            heap_release_chunk(chunk_get_heap(fc), fc);
+            a->quick_consolidated++;
+            fc = next;
+        }
+    }
+
+    a->quick_bytes = 0;
+}
+
+static void* free_list_first_fit(arena_t *a, size_t need_total) {
     for (free_chunk_t *p = a->free_list; p; p = p->prev) {
         if (!chunk_is_free(p)) continue;
         if (chunk_get_size(p) >= need_total) {
             heap_t *h = chunk_get_heap(p);
+            if (h->draining) continue;      // leave draining heaps alone so they can empty out
             return heap_split_free_chunk(h, p, need_total);
         }
     }
     return NULL;
 }
+
+/* first fit among the free chunks of draining heaps; the heap it comes from stops draining */
+static void* free_list_try_draining(arena_t *a, size_t need_total) {
+    for (free_chunk_t *p = a->free_list; p; p = p->prev) {
+        if (!chunk_is_free(p) || chunk_get_size(p) < need_total) continue;
+
+        heap_t *h = chunk_get_heap(p);
+        if (!h->draining) continue;
+
+        safe_log_msg("[freelist]: reuse a draining heap rather than map a new one\n");
+        h->draining = 0;
+        return heap_split_free_chunk(h, p, need_total);
+    }
+    return NULL;
+}
+
+void* free_list_try(arena_t *a, size_t need_total) {
+    int bin = quick_bin_index(need_total);
+
+    if (bin >= 0 && a->quick[bin]) {
+        free_chunk_t *fc = a->quick[bin];
+        a->quick[bin] = fc->prev;
+        a->quick_bytes -= need_total;
+        a->quick_hits++;
+        return fc;
+    }
+
+    return free_list_first_fit(a, need_total);
+}
+
+void* free_list_try_before_map(arena_t *a, size_t need_total) {
+    void *hdr = NULL;
+
+    // parked chunks of other sizes may merge into something big enough
+    if (a->quick_bytes > 0) {
+        quick_list_consolidate(a);
+        hdr = free_list_first_fit(a, need_total);
+    }
+
+    // the free chunks of draining heaps still beat mapping a new heap
+    if (!hdr) hdr = free_list_try_draining(a, need_total);
+    return hdr;
+}
@@ -8,6 +8,19 @@ void free_list_remove(arena_t *a, free_chunk_t *fc);
 
 void free_list_push_front(arena_t *a, free_chunk_t *fc);
 
+/* quick list for the exact size, then first fit in the freelist */
 void* free_list_try(arena_t *a, size_t need);
 
+/*
+ * no heap has room at its bump either: consolidate the quick lists and retry the freelist, then take a free chunk
+ * of a draining heap (which stops draining), before a heap is mapped
+ */
+void* free_list_try_before_map(arena_t *a, size_t need_total);
+
+/* park an in-use chunk in its quick list without coalescing; returns 0 if it is not quick-list sized */
+int quick_list_push(arena_t *a, void *hdr);
+
+/* coalesce every parked chunk into the freelist / bump */
+void quick_list_consolidate(arena_t *a);
+
 #endif
\ No newline at end of file
@@ -2,31 +2,52 @@
 #include "arena.h"
 #include "freelist.h"
 #include "debug.h"
+#include "trace.h"
 
 void heap_set_next_chunk_P(heap_t *h, void *hdr, int P) {
     void *nxt = get_next_chunk_hdr(hdr);
-    if ((uint8_t*)nxt < h->bump) chunk_set_P(nxt, P);
-}
+    if ((uint8_t*)nxt >= h->bump) return;
 
-/* if the freelist does not have a suitable chunk, carve from bump */
-void* heap_carve_from_bump(heap_t *h, size_t need_total) {
-    uintptr_t start = (uintptr_t) h->bump;
+    // a header that isn't a TLAB remainder now never becomes one while we hold the arena lock
+    if (chunk_is_tlab(nxt)) chunk_set_P_atomic(nxt, P);
+    else chunk_set_P(nxt, P);
+}
 
+static uint8_t *heap_bump_hdr(heap_t *h) {
     // Ensure payload is 16-byte aligned; header is chunk_prefix_t bytes before payload.
-    uintptr_t payload = (start + sizeof(chunk_prefix_t) + 15u) & ~((uintptr_t)15u);
-    uint8_t *hdr = (uint8_t*)(payload - sizeof(chunk_prefix_t));
+    uintptr_t payload = ((uintptr_t)h->bump + sizeof(chunk_prefix_t) + 15u) & ~((uintptr_t)15u);
+    return (uint8_t*)(payload - sizeof(chunk_prefix_t));
+}
 
-    if ((size_t)(h->end - hdr) < need_total) {
-        int status = arena_map_new_heap(h->arena, ARENA_DEFAULT_HEAP_SIZE);
+/* whether a chunk of need_total bytes fits between the bump and the end of the heap */
+int heap_has_room(heap_t *h, size_t need_total) {
+    uint8_t *hdr = heap_bump_hdr(h);
+    return hdr <= h->end && (size_t)(h->end - hdr) >= need_total;
+}
 
-        if (status == 0) {
-            return heap_carve_from_bump(h->arena->active_heap, need_total);
-        }
-        else {
-            return NULL;
-        }
+/* switch the arena to the fullest heap with room for need_total bytes, mapping a new one if none has room */
+static heap_t *heap_switch(arena_t *a, size_t need_total, size_t map_need) {
+    heap_t *next = arena_pick_heap(a, need_total);
+
+    if (!next) {
+        if (arena_map_new_heap(a, arena_heap_map_size(map_need)) < 0) return NULL;
+        next = a->active_heap;
+    }
+
+    a->active_heap = next;
+    return next;
+}
+
+/* if the freelist does not have a suitable chunk, carve from bump */
+void* heap_carve_from_bump(heap_t *h, size_t need_total) {
+    if (!heap_has_room(h, need_total)) {
+        // older heaps may have room at their bump again, e.g. after their tail was freed or tkmalloc_arena_reset()
+        heap_t *next = heap_switch(h->arena, need_total, need_total);
+        return next ? heap_carve_from_bump(next, need_total) : NULL;
     }
 
+    uint8_t *hdr = heap_bump_hdr(h);
+
     chunk_write_size_to_hdr(hdr, need_total);
 
     // Note that the chunk right before the bump is in-use.
@@ -37,9 +58,76 @@ void* heap_carve_from_bump(heap_t *h, size_t need_total) {
     chunk_set_heap(hdr, h);
 
     h->bump = hdr + need_total;
+    h->used += need_total;
     return hdr;
 }
 
+/* like heap_carve_from_bump, but the payload is aligned to align (a power of two above 16) */
+void* heap_carve_aligned(heap_t *h, size_t need_total, size_t align) {
+    const size_t MIN_FREE = get_free_chunk_min_size();
+
+    // where heap_carve_from_bump would put the next header
+    uintptr_t start = (uintptr_t) h->bump;
+    uintptr_t first = ((start + sizeof(chunk_prefix_t) + 15u) & ~((uintptr_t)15u)) - sizeof(chunk_prefix_t);
+
+    // the gap in front of the aligned chunk becomes a free chunk, so it is either empty or big enough to be one
+    uintptr_t payload = (first + sizeof(chunk_prefix_t) + align - 1) & ~((uintptr_t)align - 1);
+    while (payload - sizeof(chunk_prefix_t) != first && payload - sizeof(chunk_prefix_t) - first < MIN_FREE) {
+        payload += align;
+    }
+
+    uint8_t *hdr = (uint8_t*)(payload - sizeof(chunk_prefix_t));
+
+    if (hdr > h->end || (size_t)(h->end - hdr) < need_total) {
+        // enough room for any gap the alignment can leave
+        heap_t *next = heap_switch(h->arena, need_total + align + MIN_FREE, need_total + align + MIN_FREE);
+        return next ? heap_carve_aligned(next, need_total, align) : NULL;
+    }
+
+    size_t gap = (size_t)(hdr - (uint8_t*)first);
+
+    if (gap > 0) {
+        // carve the gap as an in-use chunk first, then release it once its right neighbor exists,
+        // so it is coalesced and pushed to the freelist like any other free
+        void *gap_hdr = heap_carve_from_bump(h, gap);
+        void *aligned = heap_carve_from_bump(h, need_total);
+        heap_release_chunk(h, gap_hdr);
+        return aligned;
+    }
+
+    return heap_carve_from_bump(h, need_total);
+}
+
+/* carve up to n chunks of need_total bytes back to back from the bump; returns how many were carved */
+size_t heap_carve_run(heap_t *h, size_t need_total, size_t n, void **out_payloads) {
+    if (n == 0) return 0;
+
+    // the first chunk may map a new heap, so the rest of the run comes from whichever heap it landed in
+    void *first = heap_carve_from_bump(h, need_total);
+    if (!first) return 0;
+
+    out_payloads[0] = chunk_hdr_to_payload(first);
+    h = chunk_get_heap(first);
+
+    // need_total is a multiple of 16, so the bump stays payload-aligned and the run needs no padding
+    size_t fit = (size_t)(h->end - h->bump) / need_total;
+    if (fit > n - 1) fit = n - 1;
+
+    uint8_t *hdr = h->bump;
+
+    for (size_t i = 1; i <= fit; i++) {
+        chunk_write_size_to_hdr(hdr, need_total);
+        chunk_set_P(hdr, 1);
+        chunk_set_heap(hdr, h);
+        out_payloads[i] = chunk_hdr_to_payload(hdr);
+        hdr += need_total;
+    }
+
+    h->bump = hdr;
+    h->used += fit * need_total;
+    return fit + 1;
+}
+
 /* last chunk here means chunk right before the bump */
 static int heap_is_last_chunk(heap_t *h, void *hdr) {
     void *nxt = get_next_chunk_hdr(hdr);
@@ -66,7 +154,8 @@ void* heap_coalesce_free_chunk(heap_t *h, void *hdr) {
         // remember that the way we check whether a chunk is free is by inspecing the P flag of the NEXT chunk hdr
         // so if the next header is the last chunk in the heap, it is not safe to call chunk_is_free, we are reading
         // from the unexplored region.
-        if (!heap_is_last_chunk(h, nxt) && chunk_is_free(nxt)) {
+        // a TLAB remainder is in use; check it first, its size may be changing under us
+        if (!chunk_is_tlab(nxt) && !heap_is_last_chunk(h, nxt) && chunk_is_free(nxt)) {
             size_t nxt_sz = chunk_get_size(nxt);
             free_list_remove(h->arena, (free_chunk_t*)nxt);
             csz += nxt_sz;
@@ -88,6 +177,7 @@ void* heap_coalesce_free_chunk(heap_t *h, void *hdr) {
         hdr = prv;
     }
 
+    TRACE2(coalesce, hdr, csz);
     return hdr;
 }
 
@@ -119,6 +209,8 @@ void* heap_split_free_chunk(heap_t *h, free_chunk_t *fc, size_t need) {
         ((free_chunk_t*)rem)->next = NULL;
         free_list_push_front(h->arena, (free_chunk_t*)rem);
 
+        h->used += need;
+        TRACE3(freelist_split, base, need, rem_sz);
         return base;
     }
 
@@ -127,6 +219,54 @@ void* heap_split_free_chunk(heap_t *h, free_chunk_t *fc, size_t need) {
 
     chunk_set_heap(fc, h);
     heap_set_next_chunk_P(h, fc, 1);
+    h->used += csz;
 
     return fc;
 }
+
+/* give an in-use chunk back to its arena: coalesce, then shrink the bump or push to the freelist (arena lock held) */
+int heap_release_chunk(heap_t *h, void *hdr) {
+    arena_t *a = h->arena;
+    size_t csz = chunk_get_size(hdr);
+
+    chunk_write_size_to_hdr(hdr, csz);
+    chunk_write_ftr(hdr, csz);
+
+    h->used -= csz;
+
+    // stop placing chunks in a nearly empty heap we aren't carving from, so its last chunks can die out
+    if (!h->draining && h != a->active_heap && h->used < (size_t)(h->end - h->base) / HEAP_DRAIN_DIVISOR) {
+        safe_log_msg("[free]: heap nearly empty, drain heap\n");
+        h->draining = 1;
+    }
+
+    safe_log_msg("[free]: merge free chunk\n");
+    free_chunk_t *merged = heap_coalesce_free_chunk(h, hdr);
+
+    size_t msz = chunk_get_size(merged);
+
+    uint8_t *merged_end = (uint8_t*)merged + msz;
+
+    heap_set_next_chunk_P(h, merged, 0);
+
+    // if the freed chunk touches the top of THIS heap, shrink bump
+    if (merged_end == h->bump) {
+        safe_log_msg("[free]: shrink bump\n");
+        h->bump = (uint8_t*)merged;
+
+        // unmap heap if it is completely free (the first header sits past base when base isn't payload-aligned)
+        if (h->bump == heap_first_chunk_hdr(h) && !(a->heaps == h && h->next == NULL)) {
+            safe_log_msg("[free]: heap unused, unmap heap\n");
+            arena_unmap_heap(a, h);
+            return HEAP_RELEASE_UNMAP;
+        }
+        return HEAP_RELEASE_BUMP;
+    }
+
+    ((free_chunk_t*)merged)->prev = NULL;
+    ((free_chunk_t*)merged)->next = NULL;
+
+    safe_log_msg("[free]: push free chunk to freelist\n");
+    free_list_push_front(a, (free_chunk_t*)merged);
+    return HEAP_RELEASE_FREELIST;
+}
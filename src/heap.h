@@ -12,17 +12,38 @@ typedef struct heap {
     uint8_t *base;
     uint8_t *bump;
     uint8_t *end;
+    size_t used;        // bytes in chunks handed out and not yet released (cached and quick-listed chunks count)
+    int draining;       // nearly empty: nothing new is placed here, so it can empty out and be unmapped
 } heap_t;
 
+/* a heap that isn't being carved from is drained once less than 1/HEAP_DRAIN_DIVISOR of it is in use */
+#define HEAP_DRAIN_DIVISOR 8
+
 void heap_set_next_chunk_P(heap_t *h, void *hdr, int P);
 
-/* if the freelist does not have a suitable chunk, carve from bump */
+/* whether a chunk of need_total bytes fits between the bump and the end of the heap */
+int heap_has_room(heap_t *h, size_t need_total);
+
+/* carve exactly need_total bytes from h's bump, or from the fullest heap with room, mapping a new one if none has */
 void* heap_carve_from_bump(heap_t *h, size_t need_total);
 
+/* like heap_carve_from_bump, but the payload is aligned to align (a power of two above 16) */
+void* heap_carve_aligned(heap_t *h, size_t need_total, size_t align);
+
+/* carve up to n chunks of need_total bytes back to back from the bump; returns how many were carved */
+size_t heap_carve_run(heap_t *h, size_t need_total, size_t n, void **out_payloads);
+
 /* merge chunk with adjacent free chunks (adjacent in memory, not in the linked list) */
 void* heap_coalesce_free_chunk(heap_t *h, void *hdr);
 
 /* if the free chunk is large enough, split the chunk */
 void* heap_split_free_chunk(heap_t *h, free_chunk_t *fc, size_t need);
 
+#define HEAP_RELEASE_FREELIST 0     // pushed to the arena freelist
+#define HEAP_RELEASE_BUMP 1         // touched the top of the heap, the bump shrank
+#define HEAP_RELEASE_UNMAP 2        // the heap became empty and was unmapped
+
+/* give an in-use chunk back to its arena: coalesce, then shrink the bump or push to the freelist (arena lock held) */
+int heap_release_chunk(heap_t *h, void *hdr);
+
 #endif
\ No newline at end of file
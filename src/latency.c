@@ -0,0 +1,181 @@
+#include <pthread.h>
+#include <stdio.h>      // for snprintf
+#include <stdlib.h>     // for atexit, getenv
+#include <string.h>     // for memset
+#include <sys/mman.h>   // for mmap
+#include "latency.h"
+#include "debug.h"
+#include "util.h"
+
+static const char *g_path_names[TKMALLOC_NUM_PATHS] = { "tcache", "freelist", "bump", "heap", "large", "tlab" };
+
+#ifdef TKMALLOC_STATS
+
+/*
+ * Each thread records into its own block without atomics; snapshots just sum all blocks.
+ * Blocks are never unmapped: when a thread exits its block is handed to the next new thread,
+ * which keeps adding to the same counters, so totals stay correct and memory is bounded by the
+ * peak thread count.
+ */
+typedef struct lat_block {
+    tkmalloc_latency_t hist;
+    struct lat_block *next;
+    int in_use;
+} lat_block_t;
+
+static lat_block_t *g_lat_blocks = NULL;
+static pthread_mutex_t g_lat_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_lat_key;
+static int g_lat_key_ok = 0;
+static _Thread_local lat_block_t *t_lat = NULL;
+
+static void lat_release(void *arg) {
+    lat_block_t *b = (lat_block_t *)arg;
+
+    pthread_mutex_lock(&g_lat_lock);
+    b->in_use = 0;
+    pthread_mutex_unlock(&g_lat_lock);
+
+    t_lat = NULL;
+}
+
+static lat_block_t *lat_acquire(void) {
+    lat_block_t *b;
+
+    pthread_mutex_lock(&g_lat_lock);
+
+    for (b = g_lat_blocks; b; b = b->next) {
+        if (!b->in_use) break;
+    }
+
+    if (!b) {
+        void *mem = mmap(NULL, align_pagesize(sizeof(lat_block_t)), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (mem == MAP_FAILED) {
+            pthread_mutex_unlock(&g_lat_lock);
+            return NULL;
+        }
+
+        b = (lat_block_t *)mem;
+        b->next = g_lat_blocks;
+        g_lat_blocks = b;
+    }
+
+    b->in_use = 1;
+    pthread_mutex_unlock(&g_lat_lock);
+
+    if (g_lat_key_ok) pthread_setspecific(g_lat_key, b);
+    return b;
+}
+
+void lat_record(int op, int path, uint64_t start) {
+    uint64_t ticks = lat_now() - start;
+
+    if (!t_lat) {
+        t_lat = lat_acquire();
+        if (!t_lat) return;
+    }
+
+    int bucket = 63 - __builtin_clzll(ticks | 1);
+
+    if (op == LAT_OP_MALLOC) t_lat->hist.malloc_hist[path][bucket]++;
+    else t_lat->hist.free_hist[path][bucket]++;
+}
+
+int tkmalloc_latency_snapshot(tkmalloc_latency_t *out) {
+    if (!out) return -1;
+
+    memset(out, 0, sizeof(*out));
+
+    pthread_mutex_lock(&g_lat_lock);
+
+    for (lat_block_t *b = g_lat_blocks; b; b = b->next) {
+        for (int p = 0; p < TKMALLOC_NUM_PATHS; p++) {
+            for (int i = 0; i < TKMALLOC_LATENCY_BUCKETS; i++) {
+                out->malloc_hist[p][i] += b->hist.malloc_hist[p][i];
+                out->free_hist[p][i] += b->hist.free_hist[p][i];
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&g_lat_lock);
+    return 0;
+}
+
+#else
+
+int tkmalloc_latency_snapshot(tkmalloc_latency_t *out) {
+    (void)out;
+    return -1;
+}
+
+#endif
+
+/* upper bound (in ticks) of the bucket that contains the q-th fraction of the samples */
+static uint64_t lat_percentile(const uint64_t *hist, uint64_t count, double q) {
+    uint64_t target = (uint64_t)((double)count * q);
+    uint64_t seen = 0;
+
+    for (int i = 0; i < TKMALLOC_LATENCY_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen > target) return (i >= 63) ? UINT64_MAX : ((uint64_t)2 << i);
+    }
+    return UINT64_MAX;
+}
+
+static void lat_dump_hists(int fd, const char *op, uint64_t hists[TKMALLOC_NUM_PATHS][TKMALLOC_LATENCY_BUCKETS]) {
+    char line[256];
+
+    for (int p = 0; p < TKMALLOC_NUM_PATHS; p++) {
+        uint64_t count = 0;
+        for (int i = 0; i < TKMALLOC_LATENCY_BUCKETS; i++) count += hists[p][i];
+
+        if (count == 0) continue;
+
+        int n = snprintf(line, sizeof(line), "%-6s %-8s count=%-10llu p50<=%-8llu p99<=%-8llu p99.9<=%-8llu max<=%llu\n",
+            op, g_path_names[p], (unsigned long long)count,
+            (unsigned long long)lat_percentile(hists[p], count, 0.50),
+            (unsigned long long)lat_percentile(hists[p], count, 0.99),
+            (unsigned long long)lat_percentile(hists[p], count, 0.999),
+            (unsigned long long)lat_percentile(hists[p], count, 1.0 - 1e-12));
+
+        if (n > 0) ignore_write_result(write(fd, line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1));
+    }
+}
+
+void tkmalloc_latency_dump(int fd) {
+    // static: the snapshot is ~5 KiB, too big to put on an arbitrary thread's stack at exit
+    static tkmalloc_latency_t snap;
+    static pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER;
+
+    pthread_mutex_lock(&dump_lock);
+
+    if (tkmalloc_latency_snapshot(&snap) < 0) {
+        const char *msg = "tkmalloc: latency histograms need a `make STATS=1` build\n";
+        ignore_write_result(write(fd, msg, safe_strlen(msg)));
+        pthread_mutex_unlock(&dump_lock);
+        return;
+    }
+
+    const char *hdr = "tkmalloc latency (ticks, bucket upper bounds):\n";
+    ignore_write_result(write(fd, hdr, safe_strlen(hdr)));
+
+    lat_dump_hists(fd, "malloc", snap.malloc_hist);
+    lat_dump_hists(fd, "free", snap.free_hist);
+
+    pthread_mutex_unlock(&dump_lock);
+}
+
+#ifdef TKMALLOC_STATS
+static void lat_dump_at_exit(void) {
+    tkmalloc_latency_dump(STDERR_FILENO);
+}
+#endif
+
+void latency_init(void) {
+#ifdef TKMALLOC_STATS
+    g_lat_key_ok = (pthread_key_create(&g_lat_key, lat_release) == 0);
+
+    if (getenv("TKMALLOC_LATENCY_DUMP")) atexit(lat_dump_at_exit);
+#endif
+}
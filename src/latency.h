@@ -0,0 +1,42 @@
+#ifndef TKMALLOC_LATENCY_H
+#define TKMALLOC_LATENCY_H
+
+#include <stdint.h>
+#include "malloc.h"
+
+#define LAT_OP_MALLOC 0
+#define LAT_OP_FREE 1
+
+/* registers the at-exit dump if TKMALLOC_LATENCY_DUMP is set */
+void latency_init(void);
+
+#ifdef TKMALLOC_STATS
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>      // __rdtsc
+
+static inline uint64_t lat_now(void) { return __rdtsc(); }
+#else
+#include <time.h>
+
+static inline uint64_t lat_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+/* add (now - start) to the calling thread's histogram for op / path */
+void lat_record(int op, int path, uint64_t start);
+
+#define LAT_BEGIN()         uint64_t lat_start_ = lat_now()
+#define LAT_END(op, path)   lat_record((op), (path), lat_start_)
+
+#else
+
+#define LAT_BEGIN()         ((void)0)
+#define LAT_END(op, path)   ((void)0)
+
+#endif
+
+#endif
@@ -3,13 +3,76 @@
 #include "debug.h"
 #include "freelist.h"
 #include "heap.h"
+#include "latency.h"
+#include "malloc.h"
+#include "numa.h"
+#include "percpu.h"
+#include "pressure.h"
+#include "region.h"
 #include "tcache.h"
+#include "tlab.h"
+#include "trace.h"
 #include "util.h"
 
-void *malloc(size_t size) {
+#define FREE_BATCH_WINDOW 64    // pointers whose owners are resolved at a time by tkmalloc_free_batch
+
+/* front-end cache: per-CPU when rseq is available, per-thread otherwise */
+static inline void* cache_pop(int bin) {
+    return g_percpu ? percpu_pop(bin) : tcache_pop(bin);
+}
+
+static inline int cache_push(int bin, void *hdr) {
+    return g_percpu ? percpu_push(bin, hdr) : tcache_push(bin, hdr);
+}
+
+static _Thread_local unsigned long t_cache_epoch = 0;  // pressure epoch this thread's cache was last flushed at
+
+/* give every chunk in the calling thread's (or CPU's) cache back to its heap */
+static void cache_flush(void) {
+    t_cache_epoch = pressure_epoch();
+
+    for (int bin = 0; bin < TCACHE_MAX_BINS; bin++) {
+        void *hdr;
+        while ((hdr = cache_pop(bin)) != NULL) {
+            heap_t *h = chunk_get_heap(hdr);
+            arena_t *a = h->arena;     // the release may unmap h
+            pthread_mutex_lock(&a->lock);
+            heap_release_chunk(h, hdr);
+            pthread_mutex_unlock(&a->lock);
+        }
+    }
+}
+
+/* on the slow path, catch up with a relief another thread ran: its cache flush only reached its own cache */
+static inline void cache_poll_pressure(void) {
+    if (t_cache_epoch != pressure_epoch()) cache_flush();
+}
+
+/* a heap couldn't be mapped: shed every byte we can so the caller can retry once; 0 if a relief is already underway */
+static int relieve_pressure(size_t want) {
+    if (!pressure_begin(want)) return 0;
+
+    cache_flush();
+    tlab_retire();
+
+    for (int i = 0; i < arena_count(); i++) {
+        (void)arena_trim(arena_at(i));
+    }
+
+    return 1;
+}
+
+/* a heap mapped for this request crossed the high-water mark: relieve now, while the limit still has room */
+static inline void relieve_pressure_early(size_t want) {
+    if (pressure_take_high_water() && relieve_pressure(want)) pressure_end();
+}
+
+/* the body of malloc(); *path reports which way the request was served, for the latency histograms */
+static inline void *malloc_path(size_t size, int *path) {
     ensure_global_init();
     
     safe_log_msg("[malloc]: entered malloc\n");
+    TRACE1(malloc_entry, size);
 
     if (size == 0) {
         safe_log_msg("[malloc]: requested size is 0, return NULL\n");
@@ -23,57 +86,86 @@ void *malloc(size_t size) {
         return NULL;
     }
 
-    size_t payload = align_16(size);
-    size_t need_total = align_16(sizeof(chunk_prefix_t) + payload);     // prefix + header
-    size_t min_chunk = get_free_chunk_min_size();
-
-    if (need_total < min_chunk) {
-        need_total = min_chunk;
-    }
+    size_t need_total = chunk_need_total(size);     // prefix + payload
 
     if (need_total > ARENA_DEFAULT_HEAP_SIZE) {
         safe_log_msg("[malloc]: large request alloc path\n");
-        arena_map_new_heap(a, need_total);
-        void *hdr = heap_carve_from_bump(a->active_heap, need_total);
+        *path = TKMALLOC_PATH_LARGE;
+        pthread_mutex_lock(&a->lock);
+
+        void *hdr = NULL;
+        if (arena_map_new_heap(a, arena_heap_map_size(need_total)) == 0) {
+            hdr = heap_carve_from_bump(a->active_heap, need_total);
+        }
+
+        pthread_mutex_unlock(&a->lock);
+
+        if (!hdr) {
+            safe_log_msg("[malloc]: large alloc failed, return NULL\n");
+            TRACE2(malloc_exit, NULL, size);
+            return NULL;
+        }
+
         void *ret = chunk_hdr_to_payload(hdr);
+        TRACE2(malloc_exit, ret, size);
         return ret;
     }
 
-    int bin = (int)(need_total / 16) - 2;   // 32->0, 48->1, 64->2 ... smallest is 32 (8 hdr + 16 payload -> 24 -> align -> 32)
-
-    if (bin < 0 || bin >= TCACHE_MAX_BINS) bin = -1;
+    int bin = tcache_bin_index(need_total);
 
     // 1) Try tcache first
     void *hdr = NULL;
 
     if (!g_cfg.disable_tcache && bin >= 0) {
         safe_log_msg("[malloc]: searching tcache\n");
+        hdr = cache_pop(bin);
 
-        tcache_bin_t *b = &g_tcache[bin];
+        if (hdr) TRACE1(tcache_hit, bin);
+        else TRACE1(tcache_miss, bin);
+    }
 
-        if (b->head != NULL) {
-            free_chunk_t *fc = b->head;
-            b->head = fc->prev;
-            b->count--;
-            hdr = (void*)fc;
-        }
+    // only cacheable sizes: bigger chunks are reused through the freelist and quick lists, which need the lock anyway;
+    // the bootstrap heap is too small to hand out slices of
+    int use_tlab = !g_cfg.disable_tlab && bin >= 0 && a->id != ARENA_BOOTSTRAP_ID;
+
+    // 2) If tcache miss, carve from this thread's allocation buffer without taking the lock
+    if (!hdr && use_tlab) {
+        hdr = tlab_carve(need_total);
+        if (hdr) *path = TKMALLOC_PATH_TLAB;
     }
 
-    // 2) If tcache miss, fall back to arena freelist / bump
+    // 3) Otherwise fall back to arena freelist / bump
     if (!hdr) {
         safe_log_msg("[malloc]: searching freelist\n");
 
+        if (!g_cfg.disable_tcache) cache_poll_pressure();
+
         pthread_mutex_lock(&a->lock);
 
         hdr = free_list_try(a, need_total);
+        *path = TKMALLOC_PATH_FREELIST;
+
+        // no bump can serve this (or a new slice) either: merge the parked chunks before a heap is mapped for it
+        if (!hdr && !arena_has_room(a, use_tlab ? TLAB_SLICE_SIZE : need_total)) {
+            hdr = free_list_try_before_map(a, need_total);
+        }
+
+        if (!hdr && use_tlab) {
+            safe_log_msg("[malloc]: freelist miss, refill tlab\n");
+            hdr = tlab_refill(a, need_total);
+            *path = TKMALLOC_PATH_TLAB;
+        }
 
         if (!hdr) {
             safe_log_msg("[malloc]: freelist miss, carve from top\n");
-            hdr = heap_carve_from_bump(a->active_heap, need_total);     // if free list miss, carve from top
+            heap_t *active = a->active_heap;
+            hdr = heap_carve_from_bump(active, need_total);     // if free list miss, carve from top
+            *path = (hdr && chunk_get_heap(hdr) != active) ? TKMALLOC_PATH_HEAP : TKMALLOC_PATH_BUMP;
 
             if (!hdr) {
                 safe_log_msg("[malloc]: malloc failed, return NULL\n");
                 pthread_mutex_unlock(&a->lock);
+                TRACE2(malloc_exit, NULL, size);
                 return NULL;
             }
         }
@@ -82,16 +174,38 @@ void *malloc(size_t size) {
 
     void *ret = chunk_hdr_to_payload(hdr);
     safe_log_ptr("[malloc]: allocated: ", ret);
+    TRACE2(malloc_exit, ret, size);
 
     return ret;
 }
 
-void free(void *ptr) {
+void *malloc(size_t size) {
+    LAT_BEGIN();
+
+    int path = TKMALLOC_PATH_TCACHE;
+    void *ret = malloc_path(size, &path);
+
+    if (!ret && size && relieve_pressure(size)) {
+        safe_log_msg("[malloc]: retry after relieving memory pressure\n");
+        ret = malloc_path(size, &path);
+        pressure_end();
+    }
+
+    if (ret) {
+        LAT_END(LAT_OP_MALLOC, path);
+        relieve_pressure_early(size);
+    }
+    return ret;
+}
+
+/* the body of free(); returns the path the chunk took, or -1 if there was nothing to free */
+static inline int free_path(void *ptr) {
     safe_log_msg("[free]: entered free\n");
+    TRACE1(free_entry, ptr);
 
     if (!ptr) {
         safe_log_msg("[free]: received nullptr\n");
-        return;
+        return -1;
     }
 
     ensure_global_init();
@@ -101,81 +215,345 @@ void free(void *ptr) {
     heap_t *h = chunk_get_heap(hdr);   // Route to the owning heap/arena (cross-thread correct)
     
     if (!h) {
+        // chunks of a shared heap have no heap_t; the attached region they lie in takes them back
+        if (region_free_attached(ptr)) return TKMALLOC_PATH_FREELIST;
+
         safe_log_msg("[free]: failed to find the right heap\n");
-        return;
+        return -1;
     }
 
     arena_t *a = h->arena;
 
     if (!a) {
         safe_log_msg("[free]: failed to find the right arena\n");
-        return;
+        return -1;
     }
     
-    int bin = (int)(csz / 16) - 2;
-
-    if (bin < 0 || bin >= TCACHE_MAX_BINS) {
-        bin = -1;
-    }
+    int bin = tcache_bin_index(csz);
 
-    // 1) Try to put small chunks into per-thread tcache
-    // NOTE: this caches into the current thread's tcache even for cross-thread frees.
+    // 1) Try to put small chunks into the per-CPU / per-thread cache
+    // NOTE: this caches into the current thread's (or CPU's) cache even for cross-thread frees.
     // That’s okay for correctness as long as ownership metadata remains in the chunk.
 
     if (!g_cfg.disable_tcache && bin >= 0) {
         safe_log_msg("[free]: free to tcache\n");
-        
-        tcache_bin_t *b = &g_tcache[bin];
-
-        if (b->count < TCACHE_MAX_COUNT) {
-            free_chunk_t *fc = (free_chunk_t*)hdr;
-
-            // IMPORTANT: do NOT mark as free, do NOT set footer, do NOT coalesce.
-            // Chunk stays "in-use" from the global allocator's point of view.
-            
-            fc->prev = b->head;
-            b->head = fc;
-            b->count++;
-            return;
-        }
+        if (cache_push(bin, hdr)) return TKMALLOC_PATH_TCACHE;
     }
 
-    // 2) Fall back to global free path: mark free, coalesce in the owning heap, push to arena freelist.
+    // 2) Fall back to global free path: park mid-size chunks unmerged in a quick list,
+    //    otherwise mark free, coalesce in the owning heap, push to arena freelist.
     safe_log_msg("[free]: free to freelist\n");
+    if (!g_cfg.disable_tcache) cache_poll_pressure();
+
     pthread_mutex_lock(&a->lock);
+    int released = quick_list_push(a, hdr) ? HEAP_RELEASE_FREELIST : heap_release_chunk(h, hdr);
+    pthread_mutex_unlock(&a->lock);
 
-    chunk_write_size_to_hdr(hdr, csz);
-    chunk_write_ftr(hdr, csz);
+    if (csz > ARENA_DEFAULT_HEAP_SIZE) return TKMALLOC_PATH_LARGE;
+    if (released == HEAP_RELEASE_UNMAP) return TKMALLOC_PATH_HEAP;
+    return released == HEAP_RELEASE_BUMP ? TKMALLOC_PATH_BUMP : TKMALLOC_PATH_FREELIST;
+}
+
+void free(void *ptr) {
+    LAT_BEGIN();
 
-    safe_log_msg("[free]: merge free chunk\n");
-    free_chunk_t *merged = heap_coalesce_free_chunk(h, hdr);
+    int path = free_path(ptr);
 
-    size_t msz = chunk_get_size(merged);
+    if (path >= 0) LAT_END(LAT_OP_FREE, path);
+}
 
-    uint8_t *merged_end = (uint8_t*)merged + msz;
+/* the body of tkmalloc_aligned_alloc() for alignment above 16 */
+static void *aligned_alloc_path(size_t alignment, size_t size) {
+    arena_t *a = arena_from_thread();
 
-    heap_set_next_chunk_P(h, merged, 0);
+    if (!a) {
+        safe_log_msg("[aligned_alloc]: failed to find arena; return NULL\n");
+        return NULL;
+    }
 
-    // if the freed chunk touches the top of THIS heap, shrink bump
-    if (merged_end == h->bump) {
-        safe_log_msg("[free]: shrink bump\n");
-        h->bump = (uint8_t*)merged;
+    size_t need_total = chunk_need_total(size);
 
-        // unmap heap if it is completely free
-        if (h->bump == h->base && !(a->heaps == h && h->next == NULL)) {
-            safe_log_msg("[free]: heap unused, unmap heap\n");
-            arena_unmap_heap(a, h);
-        }
+    // Carve straight from the bump at an aligned address instead of over-allocating and trimming;
+    // the padding in front becomes an ordinary free chunk.
+    pthread_mutex_lock(&a->lock);
 
-        pthread_mutex_unlock(&a->lock);
+    void *hdr;
+    if (need_total > ARENA_DEFAULT_HEAP_SIZE) {
+        size_t map_size = arena_heap_map_size(need_total + alignment + get_free_chunk_min_size());
+        hdr = arena_map_new_heap(a, map_size) == 0 ? heap_carve_aligned(a->active_heap, need_total, alignment) : NULL;
+    }
+    else {
+        hdr = heap_carve_aligned(a->active_heap, need_total, alignment);
+    }
+
+    pthread_mutex_unlock(&a->lock);
+
+    if (!hdr) {
+        safe_log_msg("[aligned_alloc]: alloc failed, return NULL\n");
+        return NULL;
+    }
+
+    return chunk_hdr_to_payload(hdr);
+}
+
+void *tkmalloc_aligned_alloc(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) return NULL;
+
+    // every chunk is 16-byte aligned already
+    if (alignment <= 16) return malloc(size);
+
+    ensure_global_init();
+
+    if (size == 0) return NULL;
+
+    void *ret = aligned_alloc_path(alignment, size);
+
+    if (!ret && relieve_pressure(size + alignment)) {
+        ret = aligned_alloc_path(alignment, size);
+        pressure_end();
+    }
+
+    if (ret) relieve_pressure_early(size + alignment);
+    return ret;
+}
+
+void tkmalloc_free_sized(void *ptr, size_t size) {
+    if (!ptr) return;
+
+    LAT_BEGIN();
+
+    // The chunk size follows from the request size, so the cache path never reads the size word.
+    // The chunk may be a little larger than need_total (an unsplittable freelist chunk); caching it
+    // in the smaller bin only wastes that slack. Region chunks (no heap) must go back to their region.
+    uint8_t *hdr = chunk_payload_to_hdr(ptr);
+    int bin = tcache_bin_index(chunk_need_total(size));
+
+    if (!g_cfg.disable_tcache && bin >= 0 && chunk_get_heap(hdr) != NULL && cache_push(bin, hdr)) {
+        TRACE1(free_entry, ptr);
+        LAT_END(LAT_OP_FREE, TKMALLOC_PATH_TCACHE);
         return;
     }
 
-    ((free_chunk_t*)merged)->prev = NULL;
-    ((free_chunk_t*)merged)->next = NULL;
+    // free()'s body rather than free() itself, so the probe and the histogram see this free once
+    int path = free_path(ptr);
+
+    if (path >= 0) LAT_END(LAT_OP_FREE, path);
+}
 
-    safe_log_msg("[free]: push free chunk to freelist\n");
-    free_list_push_front(a, (free_chunk_t*)merged);
+size_t tkmalloc_malloc_batch(size_t size, size_t n, void **out_ptrs) {
+    ensure_global_init();
+
+    if (size == 0 || n == 0 || !out_ptrs) return 0;
+
+    arena_t *a = arena_from_thread();
+
+    if (!a) {
+        safe_log_msg("[malloc_batch]: failed to find arena; return 0\n");
+        return 0;
+    }
+
+    size_t need_total = chunk_need_total(size);
+    size_t got = 0;
+
+    if (need_total > ARENA_DEFAULT_HEAP_SIZE) {
+        // every large chunk gets a heap of its own, there is nothing to share
+        for (; got < n; got++) {
+            out_ptrs[got] = malloc(size);
+            if (!out_ptrs[got]) break;
+        }
+        return got;
+    }
+
+    pthread_mutex_lock(&a->lock);
+
+    // 1) Reuse free chunks first; the remainder of each split goes back to the front of the freelist,
+    //    so consecutive hits keep carving from the same chunk.
+    while (got < n) {
+        void *hdr = free_list_try(a, need_total);
+        if (!hdr && !arena_has_room(a, need_total)) hdr = free_list_try_before_map(a, need_total);
+        if (!hdr) break;
+        out_ptrs[got++] = chunk_hdr_to_payload(hdr);
+    }
+
+    // 2) Carve the rest as contiguous runs from the bump, one run per heap
+    while (got < n) {
+        size_t k = heap_carve_run(a->active_heap, need_total, n - got, out_ptrs + got);
+        if (k == 0) {
+            safe_log_msg("[malloc_batch]: carve failed, returning partial batch\n");
+            break;
+        }
+        got += k;
+    }
 
     pthread_mutex_unlock(&a->lock);
+
+    // nothing at all could be carved: relieve and try once more; a partial batch is left to the caller
+    if (got == 0 && relieve_pressure(need_total * n)) {
+        got = tkmalloc_malloc_batch(size, n, out_ptrs);
+        pressure_end();
+    }
+
+    if (got > 0) relieve_pressure_early(need_total * n);
+    return got;
+}
+
+void tkmalloc_free_batch(void **ptrs, size_t n) {
+    if (!ptrs) return;
+
+    ensure_global_init();
+
+    // Owners are looked up before anything is released: once a chunk is given back, its heap may be unmapped.
+    // Working in fixed windows keeps that lookup table on the stack.
+    for (size_t start = 0; start < n; start += FREE_BATCH_WINDOW) {
+        size_t cnt = n - start < FREE_BATCH_WINDOW ? n - start : FREE_BATCH_WINDOW;
+        arena_t *owner[FREE_BATCH_WINDOW];
+
+        // 1) Small chunks go to the tcache as in free(); remember the owning arena of everything else
+        for (size_t i = 0; i < cnt; i++) {
+            owner[i] = NULL;
+
+            void *ptr = ptrs[start + i];
+            if (!ptr) continue;
+
+            uint8_t *hdr = (uint8_t*)chunk_payload_to_hdr(ptr);
+            heap_t *h = chunk_get_heap(hdr);
+
+            if (!h && region_free_attached(ptr)) continue;
+
+            if (!h || !h->arena) {
+                safe_log_msg("[free_batch]: failed to find the right heap\n");
+                continue;
+            }
+
+            int bin = tcache_bin_index(chunk_get_size(hdr));
+            if (!g_cfg.disable_tcache && bin >= 0 && cache_push(bin, hdr)) continue;
+
+            owner[i] = h->arena;
+        }
+
+        // 2) Release each arena's group under a single lock acquisition
+        for (size_t i = 0; i < cnt; i++) {
+            arena_t *a = owner[i];
+            if (!a) continue;
+
+            pthread_mutex_lock(&a->lock);
+            for (size_t j = i; j < cnt; j++) {
+                if (owner[j] != a) continue;
+
+                void *hdr = chunk_payload_to_hdr(ptrs[start + j]);
+                if (!quick_list_push(a, hdr)) heap_release_chunk(chunk_get_heap(hdr), hdr);
+                owner[j] = NULL;
+            }
+            pthread_mutex_unlock(&a->lock);
+        }
+    }
+}
+
+int tkmalloc_quick_stats(tkmalloc_quick_stats_t *out) {
+    if (!out) return -1;
+
+    ensure_global_init();
+
+    out->deferred_frees = out->reused_chunks = out->consolidations = out->consolidated_chunks = 0;
+
+    for (int i = 0; i < arena_count(); i++) {
+        arena_t *a = arena_at(i);
+
+        pthread_mutex_lock(&a->lock);
+        out->deferred_frees += a->quick_frees;
+        out->reused_chunks += a->quick_hits;
+        out->consolidations += a->quick_consolidations;
+        out->consolidated_chunks += a->quick_consolidated;
+        pthread_mutex_unlock(&a->lock);
+    }
+
+    return 0;
+}
+
+int tkmalloc_heap_stats(tkmalloc_heap_stats_t *out) {
+    if (!out) return -1;
+
+    ensure_global_init();
+
+    out->heaps = out->draining_heaps = out->mapped_bytes = out->used_bytes = out->spare_heaps = 0;
+
+    for (int i = 0; i < arena_count(); i++) {
+        arena_t *a = arena_at(i);
+
+        pthread_mutex_lock(&a->lock);
+        for (heap_t *h = a->heaps; h; h = h->next) {
+            out->heaps++;
+            out->draining_heaps += h->draining ? 1 : 0;
+            out->mapped_bytes += (uint64_t)(h->end - (uint8_t *)h);
+            out->used_bytes += h->used;
+        }
+        out->spare_heaps += a->spare ? 1 : 0;
+        pthread_mutex_unlock(&a->lock);
+    }
+
+    return 0;
+}
+
+_Static_assert(TKMALLOC_MAX_NODES == NUMA_MAX_NODES, "public and internal node limits differ");
+
+int tkmalloc_numa_stats(tkmalloc_numa_stats_t *out) {
+    if (!out) return -1;
+
+    ensure_global_init();
+
+    out->nodes = g_numa.num_nodes;
+    for (int n = 0; n < TKMALLOC_MAX_NODES; n++) {
+        out->arenas[n] = 0;
+        out->heaps[n] = 0;
+    }
+
+    arena_t *mine = arena_of_thread();
+    out->thread_node = mine ? mine->node : NUMA_NO_NODE;
+
+    for (int i = 0; i < arena_count(); i++) {
+        arena_t *a = arena_at(i);
+        int n = a->node == NUMA_NO_NODE ? 0 : a->node;
+
+        out->arenas[n]++;
+
+        pthread_mutex_lock(&a->lock);
+        for (heap_t *h = a->heaps; h; h = h->next) out->heaps[n]++;
+        pthread_mutex_unlock(&a->lock);
+    }
+
+    return 0;
+}
+
+size_t tkmalloc_thread_prewarm(size_t per_class) {
+    ensure_global_init();
+
+    if (g_cfg.disable_tcache) return 0;
+
+    size_t cached = 0;
+
+    for (int c = 0; c < SIZE_CLASS_COUNT; c++) {
+        size_t size = g_size_class_size[c] - sizeof(chunk_prefix_t);    // a request that rounds up to exactly class c
+        int bin = tcache_bin_index(chunk_need_total(size));
+        size_t left = per_class;
+
+        while (left > 0) {
+            void *ptrs[TCACHE_MAX_COUNT];
+            size_t want = left < TCACHE_MAX_COUNT ? left : TCACHE_MAX_COUNT;
+            size_t got = tkmalloc_malloc_batch(size, want, ptrs);
+            size_t pushed = 0;
+
+            while (pushed < got && cache_push(bin, chunk_payload_to_hdr(ptrs[pushed]))) pushed++;
+
+            cached += pushed;
+            left -= pushed;
+
+            // the bin is full (or memory ran out): hand the rest back
+            if (pushed < got || got < want) {
+                for (size_t i = pushed; i < got; i++) free(ptrs[i]);
+                break;
+            }
+        }
+    }
+
+    return cached;
 }
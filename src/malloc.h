@@ -2,9 +2,211 @@
 #define MY_ALLOC_H
 
 #include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 void *malloc(size_t size);
 
 void free(void *ptr);
 
-#endif
\ No newline at end of file
+/*
+ * Aligned allocation; alignment must be a power of two. The chunk is carved at an aligned address
+ * rather than over-allocated, and is released with free() as usual.
+ */
+void *tkmalloc_aligned_alloc(size_t alignment, size_t size);
+
+/* free() for callers that know the requested size (e.g. C++ sized delete): skips the size lookup on the cache path */
+void tkmalloc_free_sized(void *ptr, size_t size);
+
+/*
+ * Batch allocation: fills out_ptrs with up to n blocks of `size` bytes, carved under a single arena
+ * lock acquisition (contiguous when they come from the bump). Returns how many were allocated.
+ */
+size_t tkmalloc_malloc_batch(size_t size, size_t n, void **out_ptrs);
+
+/* free n pointers (NULL entries are skipped), locking each owning arena once per group */
+void tkmalloc_free_batch(void **ptrs, size_t n);
+
+/*
+ * User-created arenas, for objects that all die together (e.g. per-request state).
+ * Memory returned by tkmalloc_arena_alloc() must NOT be passed to free(); it is released
+ * all at once by tkmalloc_arena_reset() (heaps are kept for reuse) or tkmalloc_arena_destroy().
+ */
+typedef struct arena tkmalloc_arena_t;
+
+tkmalloc_arena_t *tkmalloc_arena_create(void);
+
+void *tkmalloc_arena_alloc(tkmalloc_arena_t *a, size_t size);
+
+/* rewind every heap's bump to its base and drop the free list, O(#heaps) */
+void tkmalloc_arena_reset(tkmalloc_arena_t *a);
+
+/* unmap all heaps of the arena and the arena itself */
+void tkmalloc_arena_destroy(tkmalloc_arena_t *a);
+
+/*
+ * Per-operation latency histograms, only collected by `make STATS=1` builds.
+ * Set TKMALLOC_LATENCY_DUMP=1 to print them at exit. Latencies are in rdtsc ticks
+ * (nanoseconds on targets without a TSC); bucket b counts operations that took [2^b, 2^(b+1)) ticks.
+ */
+enum {
+    TKMALLOC_PATH_TCACHE,       // served by / returned to the per-CPU or per-thread cache
+    TKMALLOC_PATH_FREELIST,     // malloc: reused a freelist chunk, free: coalesced and pushed to the freelist
+    TKMALLOC_PATH_BUMP,         // malloc: carved from the active heap, free: shrank the bump
+    TKMALLOC_PATH_HEAP,         // malloc: needed another heap (usually a new mmap), free: unmapped a heap
+    TKMALLOC_PATH_LARGE,        // request larger than a default heap, served by a dedicated heap
+    TKMALLOC_PATH_TLAB,         // malloc: carved from the thread's allocation buffer without the arena lock
+    TKMALLOC_NUM_PATHS
+};
+
+#define TKMALLOC_LATENCY_BUCKETS 64
+
+typedef struct tkmalloc_latency {
+    uint64_t malloc_hist[TKMALLOC_NUM_PATHS][TKMALLOC_LATENCY_BUCKETS];
+    uint64_t free_hist[TKMALLOC_NUM_PATHS][TKMALLOC_LATENCY_BUCKETS];
+} tkmalloc_latency_t;
+
+/* sum the histograms of every thread into *out; returns -1 if the library was built without STATS=1 */
+int tkmalloc_latency_snapshot(tkmalloc_latency_t *out);
+
+/* write count and p50 / p99 / p99.9 / max bucket per operation and path to fd */
+void tkmalloc_latency_dump(int fd);
+
+/*
+ * Deferred coalescing: mid-size chunks freed past the cache are parked unmerged in per-arena quick lists
+ * and only coalesced when an allocation would otherwise map a new heap or too many bytes pile up
+ * (TKMALLOC_DISABLE_QUICKLIST=1 turns it off).
+ * Every reused chunk is one merge plus one split that never happened.
+ */
+typedef struct tkmalloc_quick_stats {
+    uint64_t deferred_frees;        // frees parked without coalescing
+    uint64_t reused_chunks;         // allocations served straight from a quick list
+    uint64_t consolidations;        // bulk coalescing passes
+    uint64_t consolidated_chunks;   // parked chunks that were eventually coalesced
+} tkmalloc_quick_stats_t;
+
+/* sum the counters of all global arenas */
+int tkmalloc_quick_stats(tkmalloc_quick_stats_t *out);
+
+/*
+ * Heap occupancy: new chunks are packed into the fullest heaps, and a nearly empty heap that isn't being
+ * carved from is drained (nothing new is placed there) until its last chunk is freed and it is unmapped.
+ */
+typedef struct tkmalloc_heap_stats {
+    uint64_t heaps;                 // heaps currently mapped
+    uint64_t draining_heaps;        // of those, heaps being drained
+    uint64_t mapped_bytes;
+    uint64_t used_bytes;            // bytes in chunks handed out, including those parked in caches and quick lists
+    uint64_t spare_heaps;           // latency mode: prefaulted heaps held in reserve, not counted above
+} tkmalloc_heap_stats_t;
+
+/* sum the heaps of all global arenas */
+int tkmalloc_heap_stats(tkmalloc_heap_stats_t *out);
+
+/* how the global arenas are laid out over NUMA nodes (dense node indices, see numa.h) */
+#define TKMALLOC_MAX_NODES 64
+
+typedef struct tkmalloc_numa_stats {
+    int nodes;                              // 1 when the topology is flat or couldn't be read
+    int thread_node;                        // node of the calling thread's arena, -1 if unbound or none yet
+    int arenas[TKMALLOC_MAX_NODES];         // arenas per node (all on node 0 when nodes == 1)
+    uint64_t heaps[TKMALLOC_MAX_NODES];     // heaps those arenas have mapped, bound to that node
+} tkmalloc_numa_stats_t;
+
+int tkmalloc_numa_stats(tkmalloc_numa_stats_t *out);
+
+/*
+ * Memory pressure: when a new heap can't be mapped, because mmap failed or it would take the mapped total past
+ * TKMALLOC_SOFT_LIMIT (e.g. "512M"), malloc calls the pressure callback, flushes the thread caches, merges the
+ * quick lists, returns the pages of free memory to the OS and retries once. The limit is soft: the retry
+ * may go over it. The same relief runs after an allocation whose new heap took the total past 90% of the limit.
+ * Only the calling thread's cache is flushed; other threads flush theirs on their next slow path.
+ * The callback runs without allocator locks held and may free memory; want is the request size.
+ */
+typedef void (*tkmalloc_pressure_fn)(size_t want, void *arg);
+
+void tkmalloc_set_pressure_callback(tkmalloc_pressure_fn fn, void *arg);
+
+/* bytes currently mapped for heaps, the figure the soft limit applies to */
+size_t tkmalloc_mapped_bytes(void);
+
+/*
+ * Latency mode (TKMALLOC_LATENCY_MODE=1) prefaults every heap and keeps a spare one ready per arena.
+ * tkmalloc_thread_prewarm() also fills the calling thread's (or CPU's) cache with up to per_class chunks of every
+ * size class, so its first allocations don't take the arena lock. Returns how many chunks were cached.
+ */
+size_t tkmalloc_thread_prewarm(size_t per_class);
+
+/*
+ * Shared-memory heaps, for handing objects to cooperating processes without copying them. A shared heap is one
+ * fixed-size region in a named POSIX shm object ("/name", see shm_open(3)) or, without a name, an anonymous
+ * memfd that can be inherited or passed over a socket. Its metadata is stored as offsets and guarded by a
+ * process-shared robust mutex, so every process that maps it can allocate and free. A process maps the region at
+ * its own address, so pass objects as offsets. Objects may be released with tkmalloc_shm_free() or free().
+ */
+typedef struct region tkmalloc_shm_t;
+
+tkmalloc_shm_t *tkmalloc_shm_create(const char *name, size_t size);
+
+/* attach to a shared heap another process created, by name or by (a duplicate of) its memfd */
+tkmalloc_shm_t *tkmalloc_shm_open(const char *name);
+
+tkmalloc_shm_t *tkmalloc_shm_open_fd(int fd);
+
+int tkmalloc_shm_fd(tkmalloc_shm_t *s);
+
+/* unmap this process's view; the shared object lives on until it is unlinked (shm_unlink) and closed everywhere */
+void tkmalloc_shm_close(tkmalloc_shm_t *s);
+
+/* NULL if the region is full, or for good once a process died in the middle of changing its metadata */
+void *tkmalloc_shm_alloc(tkmalloc_shm_t *s, size_t size);
+
+void tkmalloc_shm_free(tkmalloc_shm_t *s, void *ptr);
+
+/* translate between this process's pointers and offsets valid in every process */
+uint64_t tkmalloc_shm_offset(tkmalloc_shm_t *s, const void *ptr);
+
+void *tkmalloc_shm_ptr(tkmalloc_shm_t *s, uint64_t off);
+
+/*
+ * Persistent heaps, for state that should survive a restart. A persistent heap is a region of the same kind
+ * mapped from a file: the bump, freelist and root object are stored as offsets inside the file, so after a
+ * restart the process reopens the file and finds its objects and its free space where it left them.
+ * Objects must link to each other by offset, since the file is mapped at a new address every time.
+ */
+typedef struct region tkmalloc_pheap_t;
+
+/*
+ * open the heap in path, or create it with size bytes if the file is empty or missing; a file that was sized but
+ * never laid out is formatted at its own size. Only one process may have it open. NULL on failure; errno is
+ * EUCLEAN if the file isn't a heap, or its last user died mid-update
+ */
+tkmalloc_pheap_t *tkmalloc_pheap_open(const char *path, size_t size);
+
+/* write the heap back to its file (msync) */
+int tkmalloc_pheap_sync(tkmalloc_pheap_t *p);
+
+/* sync and unmap */
+void tkmalloc_pheap_close(tkmalloc_pheap_t *p);
+
+void *tkmalloc_pheap_alloc(tkmalloc_pheap_t *p, size_t size);
+
+void tkmalloc_pheap_free(tkmalloc_pheap_t *p, void *ptr);
+
+/* the object to start from after a restart, NULL until one is set */
+void *tkmalloc_pheap_root(tkmalloc_pheap_t *p);
+
+void tkmalloc_pheap_set_root(tkmalloc_pheap_t *p, void *obj);
+
+uint64_t tkmalloc_pheap_offset(tkmalloc_pheap_t *p, const void *ptr);
+
+void *tkmalloc_pheap_ptr(tkmalloc_pheap_t *p, uint64_t off);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
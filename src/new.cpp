@@ -0,0 +1,67 @@
+#include <cstddef>
+#include <new>
+#include "malloc.h"
+
+/*
+ * Replaceable global operator new / delete (C++17 set), so C++ allocations reach tkmalloc directly
+ * with their size and alignment instead of going through libstdc++'s malloc wrappers.
+ */
+
+namespace {
+
+void *new_impl(std::size_t size, std::size_t align) {
+    // new must return a unique pointer even for 0 bytes, but tkmalloc's malloc(0) returns NULL
+    if (size == 0) size = 1;
+
+    for (;;) {
+        void *p = align > 16 ? tkmalloc_aligned_alloc(align, size) : malloc(size);
+        if (p) return p;
+
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void *new_nothrow_impl(std::size_t size, std::size_t align) noexcept {
+    try {
+        return new_impl(size, align);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+}
+
+void *operator new(std::size_t size) { return new_impl(size, 0); }
+void *operator new[](std::size_t size) { return new_impl(size, 0); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept { return new_nothrow_impl(size, 0); }
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept { return new_nothrow_impl(size, 0); }
+
+void *operator new(std::size_t size, std::align_val_t al) { return new_impl(size, static_cast<std::size_t>(al)); }
+void *operator new[](std::size_t size, std::align_val_t al) { return new_impl(size, static_cast<std::size_t>(al)); }
+void *operator new(std::size_t size, std::align_val_t al, const std::nothrow_t &) noexcept {
+    return new_nothrow_impl(size, static_cast<std::size_t>(al));
+}
+void *operator new[](std::size_t size, std::align_val_t al, const std::nothrow_t &) noexcept {
+    return new_nothrow_impl(size, static_cast<std::size_t>(al));
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p); }
+
+// sized delete: the chunk size follows from the size, so no size lookup on the cache path
+void operator delete(void *p, std::size_t size) noexcept { tkmalloc_free_sized(p, size ? size : 1); }
+void operator delete[](void *p, std::size_t size) noexcept { tkmalloc_free_sized(p, size ? size : 1); }
+
+void operator delete(void *p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { free(p); }
+
+// aligned chunks are carved at exactly chunk_need_total(size), so sized delete applies to them too
+void operator delete(void *p, std::size_t size, std::align_val_t) noexcept { tkmalloc_free_sized(p, size ? size : 1); }
+void operator delete[](void *p, std::size_t size, std::align_val_t) noexcept { tkmalloc_free_sized(p, size ? size : 1); }
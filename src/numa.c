@@ -0,0 +1,176 @@
+#include <fcntl.h>          // for open
+#include <sched.h>          // for sched_getcpu
+#include <sys/syscall.h>    // for SYS_mbind
+#include <unistd.h>         // for read, syscall
+#include "numa.h"
+#include "debug.h"
+
+#define NUMA_MPOL_PREFERRED 1       // MPOL_PREFERRED from <linux/mempolicy.h>, avoids depending on libnuma
+#define NUMA_PATH_MAX 256
+#define NUMA_FILE_MAX 4096
+
+numa_topology_t g_numa = { .num_nodes = 1 };
+
+/*
+ * Everything here runs inside malloc's initialization, so no stdio and no opendir (both allocate):
+ * files are read into stack buffers and paths are assembled by hand.
+ */
+
+static size_t path_append(char *dst, size_t len, const char *src) {
+    while (*src && len + 1 < NUMA_PATH_MAX) dst[len++] = *src++;
+    dst[len] = '\0';
+    return len;
+}
+
+static size_t path_append_int(char *dst, size_t len, int n) {
+    char digits[12];
+    int nd = 0;
+
+    do {
+        digits[nd++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n > 0);
+
+    while (nd > 0 && len + 1 < NUMA_PATH_MAX) dst[len++] = digits[--nd];
+    dst[len] = '\0';
+    return len;
+}
+
+static int read_small_file(const char *path, char *buf, size_t cap) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    ssize_t n = read(fd, buf, cap - 1);
+    close(fd);
+
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+    return 0;
+}
+
+/* parse a decimal id below max; NULL if there is none or it is too large */
+static const char *parse_id(const char *s, int max, int *out) {
+    if (*s < '0' || *s > '9') return NULL;
+
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s++ - '0');
+        if (n >= max) return NULL;      // checked per digit, so n never overflows
+    }
+
+    *out = n;
+    return s;
+}
+
+/*
+ * Parse a kernel cpulist/nodelist such as "0-3,8,10-11" and call fn for every id.
+ * Returns the number of ids visited, or -1 on malformed input or an id of max or above.
+ */
+static int parse_list(const char *s, int max, void (*fn)(int id, void *arg), void *arg) {
+    int visited = 0;
+
+    while (*s && *s != '\n') {
+        int lo, hi;
+
+        if (!(s = parse_id(s, max, &lo))) return -1;
+
+        hi = lo;
+        if (*s == '-') {
+            if (!(s = parse_id(s + 1, max, &hi))) return -1;
+        }
+
+        if (hi < lo) return -1;
+        for (int id = lo; id <= hi; id++, visited++) fn(id, arg);
+
+        if (*s == ',') s++;
+    }
+    return visited;
+}
+
+static void add_node(int id, void *arg) {
+    (void)arg;
+    // parse_list keeps ids below NUMA_MAX_NODES (they also index the mbind nodemask); a list may still repeat them
+    if (g_numa.num_nodes < NUMA_MAX_NODES) g_numa.node_ids[g_numa.num_nodes++] = id;
+}
+
+static void add_cpu(int cpu, void *arg) {
+    int node = *(int *)arg;
+    g_numa.cpu_to_node[cpu] = (int16_t)node;
+    g_numa.cpus_per_node[node]++;
+}
+
+static void numa_reset_single_node(void) {
+    g_numa.num_nodes = 1;
+    g_numa.node_ids[0] = 0;
+    g_numa.cpus_per_node[0] = 0;
+    for (int i = 0; i < NUMA_MAX_CPUS; i++) g_numa.cpu_to_node[i] = NUMA_NO_NODE;
+}
+
+void numa_init(const char *sysfs_root) {
+    char path[NUMA_PATH_MAX];
+    char buf[NUMA_FILE_MAX];
+
+    if (!sysfs_root) sysfs_root = NUMA_DEFAULT_SYSFS_ROOT;
+
+    numa_reset_single_node();
+
+    size_t root_len = path_append(path, 0, sysfs_root);
+    path_append(path, root_len, "/online");
+
+    if (read_small_file(path, buf, sizeof(buf)) < 0) {
+        safe_log_msg("[numa_init]: no topology found, assuming a single node\n");
+        return;
+    }
+
+    g_numa.num_nodes = 0;
+    if (parse_list(buf, NUMA_MAX_NODES, add_node, NULL) < 1) {
+        safe_log_msg("[numa_init]: malformed node list, assuming a single node\n");
+        numa_reset_single_node();
+        return;
+    }
+
+    for (int n = 0; n < g_numa.num_nodes; n++) {
+        size_t len = path_append(path, root_len, "/node");
+        len = path_append_int(path, len, g_numa.node_ids[n]);
+        path_append(path, len, "/cpulist");
+
+        // memory-only nodes have an empty cpulist; they simply get no arenas
+        if (read_small_file(path, buf, sizeof(buf)) < 0) continue;
+
+        if (parse_list(buf, NUMA_MAX_CPUS, add_cpu, &n) < 0) {
+            safe_log_msg("[numa_init]: malformed cpulist, assuming a single node\n");
+            numa_reset_single_node();
+            return;
+        }
+    }
+
+    int total_cpus = 0;
+    for (int n = 0; n < g_numa.num_nodes; n++) total_cpus += g_numa.cpus_per_node[n];
+
+    if (total_cpus == 0) {
+        safe_log_msg("[numa_init]: no cpus in topology, assuming a single node\n");
+        numa_reset_single_node();
+    }
+}
+
+int numa_current_node(void) {
+    if (g_numa.num_nodes <= 1) return 0;
+
+    int cpu = sched_getcpu();
+    if (cpu < 0 || cpu >= NUMA_MAX_CPUS || g_numa.cpu_to_node[cpu] == NUMA_NO_NODE) return 0;
+
+    return g_numa.cpu_to_node[cpu];
+}
+
+void numa_bind(void *mem, size_t len, int node) {
+    if (g_numa.num_nodes <= 1 || node < 0 || node >= g_numa.num_nodes) return;
+
+    int id = g_numa.node_ids[node];
+    unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long)) + 1] = {0};
+    mask[id / (8 * sizeof(unsigned long))] |= 1UL << (id % (8 * sizeof(unsigned long)));
+
+    // a failure (e.g. a node that went offline) just leaves the default first-touch policy in place
+    if (syscall(SYS_mbind, mem, len, NUMA_MPOL_PREFERRED, mask, sizeof(mask) * 8, 0) != 0) {
+        safe_log_msg("[numa_bind]: mbind failed, keeping first-touch placement\n");
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef MYALLOC_NUMA_H
+#define MYALLOC_NUMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NUMA_MAX_NODES 64
+#define NUMA_MAX_CPUS 1024
+#define NUMA_NO_NODE -1
+#define NUMA_DEFAULT_SYSFS_ROOT "/sys/devices/system/node"
+
+/*
+ * Nodes are stored densely (0 .. num_nodes-1); node_ids maps them back to the kernel's node ids,
+ * which may be sparse. On single-node machines, or when sysfs can't be parsed, num_nodes is 1
+ * and nothing is ever bound.
+ */
+typedef struct numa_topology {
+    int num_nodes;
+    int node_ids[NUMA_MAX_NODES];
+    int cpus_per_node[NUMA_MAX_NODES];
+    int16_t cpu_to_node[NUMA_MAX_CPUS];     // NUMA_NO_NODE if unknown
+} numa_topology_t;
+
+extern numa_topology_t g_numa;
+
+/* parse <root>/online and <root>/node<N>/cpulist, root defaults to NUMA_DEFAULT_SYSFS_ROOT */
+void numa_init(const char *sysfs_root);
+
+/* dense index of the node the caller is running on, 0 if unknown */
+int numa_current_node(void);
+
+/* best-effort: prefer pages of [mem, mem + len) on the given (dense) node, before first touch */
+void numa_bind(void *mem, size_t len, int node);
+
+#endif
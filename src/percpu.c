@@ -0,0 +1,35 @@
+#include <sys/mman.h>   // for mmap
+#include <unistd.h>     // for sysconf
+#include "percpu.h"
+#include "config.h"
+#include "debug.h"
+#include "util.h"
+
+percpu_cache_t *g_percpu = NULL;
+uint32_t g_percpu_ncpus = 0;
+
+int percpu_init(void) {
+#ifdef TKMALLOC_HAVE_RSEQ
+    if (g_cfg.disable_tcache || g_cfg.disable_percpu) return -1;
+
+    // glibc registers every thread with the kernel; if it didn't (old kernel, glibc.pthread.rseq=0), bail out
+    if (__rseq_size == 0) {
+        safe_log_msg("[percpu_init]: rseq not registered, using per-thread tcache\n");
+        return -1;
+    }
+
+    long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (ncpus < 1) return -1;
+
+    size_t map_size = align_pagesize((size_t)ncpus * sizeof(percpu_cache_t));
+    void *mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mem == MAP_FAILED) return -1;
+
+    g_percpu_ncpus = (uint32_t)ncpus;
+    g_percpu = (percpu_cache_t *)mem;
+    return 0;
+#else
+    return -1;
+#endif
+}
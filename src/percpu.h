@@ -0,0 +1,142 @@
+#ifndef MYALLOC_PERCPU_H
+#define MYALLOC_PERCPU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "tcache.h"
+
+/*
+ * Per-CPU front-end cache, an alternative to the per-thread g_tcache.
+ *
+ * Each CPU owns one percpu_cache_t: for every tcache bin, a small array-based stack of chunk headers.
+ * push/pop run as restartable sequences (rseq): the thread reads its cpu_id, prepares everything,
+ * and publishes the change with a single final store to len[bin]. If the thread is preempted, migrated,
+ * or signaled before that store, the kernel aborts the sequence and we restart it, so no locks or
+ * atomic instructions are needed. Total cache memory is bounded by the core count, not the thread count.
+ *
+ * Stacks (instead of linked lists) keep the commit down to one store: a push writes the slot above len
+ * speculatively, which is harmless if aborted, then bumps len.
+ */
+
+typedef struct percpu_cache {
+    uint64_t len[TCACHE_MAX_BINS];
+    void *slots[TCACHE_MAX_BINS][TCACHE_MAX_COUNT];
+} percpu_cache_t;
+
+extern percpu_cache_t *g_percpu;        // NULL when rseq is unavailable; g_tcache is used instead
+extern uint32_t g_percpu_ncpus;
+
+/* map one cache per possible CPU if glibc registered rseq for us; returns -1 to fall back to g_tcache */
+int percpu_init(void);
+
+#if defined(__x86_64__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#define TKMALLOC_HAVE_RSEQ 1
+#endif
+#endif
+
+#ifdef TKMALLOC_HAVE_RSEQ
+
+#include <sys/rseq.h>   // __rseq_offset, __rseq_size (glibc >= 2.35)
+
+/*
+ * Layout shared by both sequences:
+ *   - the critical section descriptor (struct rseq_cs) lives in __rseq_cs, covering [1, 2)
+ *   - the abort handler (4) in __rseq_failure is preceded by the signature glibc registered with
+ *     and simply restarts from 5, which re-arms rseq->rseq_cs
+ *   - a thread whose registration failed reads a cpu_id >= g_percpu_ncpus and takes the miss path
+ * rseq->cpu_id is at offset 4 and rseq->rseq_cs at offset 8 of the thread's rseq area (%fs + __rseq_offset).
+ */
+#define PERCPU_RSEQ_PROLOGUE \
+    ".pushsection __rseq_cs, \"aw\"\n\t" \
+    ".balign 32\n\t" \
+    "3:\n\t" \
+    ".long 0x0, 0x0\n\t" \
+    ".quad 1f, (2f - 1f), 4f\n\t" \
+    ".popsection\n\t" \
+    "5:\n\t" \
+    "leaq 3b(%%rip), %%rax\n\t" \
+    "movq %%rax, %%fs:8(%[rseq])\n\t" \
+    "1:\n\t" \
+    "movl %%fs:4(%[rseq]), %%eax\n\t" \
+    "cmpl %[ncpus], %%eax\n\t" \
+    "jae 6f\n\t" \
+    "imulq %[stride], %%rax\n\t" \
+    "addq %[base], %%rax\n\t" \
+    "leaq (%%rax, %[len_off]), %%rdx\n\t" \
+    "movq (%%rdx), %%rcx\n\t"
+
+#define PERCPU_RSEQ_ABORT \
+    ".pushsection __rseq_failure, \"ax\"\n\t" \
+    ".byte 0x0f, 0xb9, 0x3d\n\t" \
+    ".long 0x53053053\n\t" \
+    "4:\n\t" \
+    "jmp 5b\n\t" \
+    ".popsection\n\t"
+
+static inline void* percpu_pop(int bin) {
+    void *ret;
+    uint64_t len_off = (uint64_t)bin * sizeof(uint64_t);
+    uint64_t slot_off = offsetof(percpu_cache_t, slots) + (uint64_t)bin * TCACHE_MAX_COUNT * sizeof(void*);
+
+    __asm__ __volatile__ (
+        PERCPU_RSEQ_PROLOGUE
+        "testq %%rcx, %%rcx\n\t"                    // empty stack: miss
+        "jz 6f\n\t"
+        "addq %[slot_off], %%rax\n\t"
+        "movq -8(%%rax, %%rcx, 8), %[ret]\n\t"      // ret = slots[bin][len - 1]
+        "decq %%rcx\n\t"
+        "movq %%rcx, (%%rdx)\n\t"                   // commit: len[bin] = len - 1
+        "2:\n\t"
+        "jmp 7f\n\t"
+        "6:\n\t"
+        "xorl %k[ret], %k[ret]\n\t"
+        "7:\n\t"
+        PERCPU_RSEQ_ABORT
+        : [ret] "=&r" (ret)
+        : [rseq] "r" (__rseq_offset), [ncpus] "r" (g_percpu_ncpus), [stride] "i" (sizeof(percpu_cache_t)),
+          [base] "r" (g_percpu), [len_off] "r" (len_off), [slot_off] "r" (slot_off)
+        : "rax", "rcx", "rdx", "memory", "cc");
+
+    return ret;
+}
+
+/* returns 0 if the bin is full or this thread can't use rseq */
+static inline int percpu_push(int bin, void *hdr) {
+    int ok;
+    uint64_t len_off = (uint64_t)bin * sizeof(uint64_t);
+    uint64_t slot_off = offsetof(percpu_cache_t, slots) + (uint64_t)bin * TCACHE_MAX_COUNT * sizeof(void*);
+
+    __asm__ __volatile__ (
+        PERCPU_RSEQ_PROLOGUE
+        "cmpq %[max], %%rcx\n\t"                    // full stack: fall back to the arena
+        "jae 6f\n\t"
+        "addq %[slot_off], %%rax\n\t"
+        "movq %[hdr], (%%rax, %%rcx, 8)\n\t"        // speculative: slots[bin][len] = hdr
+        "incq %%rcx\n\t"
+        "movq %%rcx, (%%rdx)\n\t"                   // commit: len[bin] = len + 1
+        "2:\n\t"
+        "movl $1, %[ok]\n\t"
+        "jmp 7f\n\t"
+        "6:\n\t"
+        "movl $0, %[ok]\n\t"
+        "7:\n\t"
+        PERCPU_RSEQ_ABORT
+        : [ok] "=&r" (ok)
+        : [rseq] "r" (__rseq_offset), [ncpus] "r" (g_percpu_ncpus), [stride] "i" (sizeof(percpu_cache_t)),
+          [base] "r" (g_percpu), [len_off] "r" (len_off), [slot_off] "r" (slot_off),
+          [max] "i" (TCACHE_MAX_COUNT), [hdr] "r" (hdr)
+        : "rax", "rcx", "rdx", "memory", "cc");
+
+    return ok;
+}
+
+#else
+
+static inline void* percpu_pop(int bin) { (void)bin; return NULL; }
+
+static inline int percpu_push(int bin, void *hdr) { (void)bin; (void)hdr; return 0; }
+
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+#include <errno.h>
+#include <fcntl.h>      // for open
+#include <sys/file.h>   // for flock
+#include <sys/mman.h>   // for msync
+#include <sys/stat.h>   // for fstat
+#include <unistd.h>     // for ftruncate, close
+#include "arena.h"
+#include "debug.h"
+#include "malloc.h"
+#include "region.h"
+
+/*
+ * Persistent heaps: a region (see region.h) in a file. All of its metadata, the bump, the freelist and the root
+ * object, is stored as offsets inside the file, so a restarted process maps it anywhere and carries on
+ * allocating. One process at a time: the file is flock()ed for as long as the heap is open.
+ */
+
+tkmalloc_pheap_t *tkmalloc_pheap_open(const char *path, size_t size) {
+    ensure_global_init();
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    region_t *r = NULL;
+
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        safe_log_msg("[pheap_open]: heap file is open elsewhere\n");
+    }
+    else if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        r = region_attach(fd, (size_t)st.st_size, REGION_PHEAP_MAGIC, REGION_REOPEN);
+        if (!r) errno = EUCLEAN;    // not a heap file, or one its last user died while changing
+    }
+    else if (size > 0 && ftruncate(fd, (off_t)align_pagesize(size)) == 0) {
+        r = region_attach(fd, align_pagesize(size), REGION_PHEAP_MAGIC, REGION_FORMAT);
+    }
+
+    if (!r) (void)close(fd);
+    return r;
+}
+
+int tkmalloc_pheap_sync(tkmalloc_pheap_t *p) {
+    return msync(p->base, p->size, MS_SYNC);
+}
+
+void tkmalloc_pheap_close(tkmalloc_pheap_t *p) {
+    (void)tkmalloc_pheap_sync(p);
+    region_detach(p);
+}
+
+void *tkmalloc_pheap_alloc(tkmalloc_pheap_t *p, size_t size) {
+    return region_alloc(p, size);
+}
+
+void tkmalloc_pheap_free(tkmalloc_pheap_t *p, void *ptr) {
+    region_free(p, ptr);
+}
+
+void *tkmalloc_pheap_root(tkmalloc_pheap_t *p) {
+    return region_at(p, __atomic_load_n(&region_hdr(p)->root, __ATOMIC_ACQUIRE));
+}
+
+void tkmalloc_pheap_set_root(tkmalloc_pheap_t *p, void *obj) {
+    __atomic_store_n(&region_hdr(p)->root, obj ? region_off(p, obj) : 0, __ATOMIC_RELEASE);
+}
+
+uint64_t tkmalloc_pheap_offset(tkmalloc_pheap_t *p, const void *ptr) {
+    return ptr ? region_off(p, ptr) : 0;
+}
+
+void *tkmalloc_pheap_ptr(tkmalloc_pheap_t *p, uint64_t off) {
+    return region_at(p, off);
+}
@@ -0,0 +1,82 @@
+#include <pthread.h>
+#include "config.h"
+#include "debug.h"
+#include "pressure.h"
+#include "trace.h"
+
+size_t g_mapped_bytes = 0;
+unsigned long g_pressure_epoch = 0;
+int g_pressure_high_water = 0;
+
+static pthread_mutex_t g_callback_lock = PTHREAD_MUTEX_INITIALIZER;
+static tkmalloc_pressure_fn g_callback = NULL;
+static void *g_callback_arg = NULL;
+
+static _Thread_local int t_relieving = 0;   // set from pressure_begin() until pressure_end()
+
+static size_t pressure_high_water_bytes(void) {
+    return g_cfg.soft_limit / 100 * PRESSURE_HIGH_WATER_PERCENT;
+}
+
+void pressure_account(size_t bytes, int mapped) {
+    if (!mapped) {
+        __atomic_sub_fetch(&g_mapped_bytes, bytes, __ATOMIC_RELAXED);
+        return;
+    }
+
+    size_t now = __atomic_add_fetch(&g_mapped_bytes, bytes, __ATOMIC_RELAXED);
+    size_t high = pressure_high_water_bytes();
+
+    // only the mapping that crosses it: staying above the mark doesn't ask for a relief on every heap
+    if (high > 0 && now >= high && now - bytes < high) {
+        __atomic_store_n(&g_pressure_high_water, 1, __ATOMIC_RELAXED);
+    }
+}
+
+int pressure_may_map_spare(size_t bytes) {
+    if (g_cfg.soft_limit == 0) return 1;
+    return __atomic_load_n(&g_mapped_bytes, __ATOMIC_RELAXED) + bytes < pressure_high_water_bytes();
+}
+
+int pressure_may_map(size_t bytes) {
+    if (g_cfg.soft_limit == 0 || t_relieving) return 1;
+    return __atomic_load_n(&g_mapped_bytes, __ATOMIC_RELAXED) + bytes <= g_cfg.soft_limit;
+}
+
+int pressure_begin(size_t want) {
+    // the callback may allocate, and must not start a relief of its own
+    if (t_relieving) return 0;
+    t_relieving = 1;
+
+    // this relief covers a pending high-water crossing too
+    __atomic_store_n(&g_pressure_high_water, 0, __ATOMIC_RELAXED);
+
+    safe_log_msg("[pressure]: relieving memory pressure\n");
+    TRACE2(pressure, want, tkmalloc_mapped_bytes());
+
+    pthread_mutex_lock(&g_callback_lock);
+    tkmalloc_pressure_fn fn = g_callback;
+    void *arg = g_callback_arg;
+    pthread_mutex_unlock(&g_callback_lock);
+
+    // no allocator locks are held here, so the application can free whatever it likes
+    if (fn) fn(want, arg);
+
+    __atomic_add_fetch(&g_pressure_epoch, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+void pressure_end(void) {
+    t_relieving = 0;
+}
+
+void tkmalloc_set_pressure_callback(tkmalloc_pressure_fn fn, void *arg) {
+    pthread_mutex_lock(&g_callback_lock);
+    g_callback = fn;
+    g_callback_arg = arg;
+    pthread_mutex_unlock(&g_callback_lock);
+}
+
+size_t tkmalloc_mapped_bytes(void) {
+    return __atomic_load_n(&g_mapped_bytes, __ATOMIC_RELAXED);
+}
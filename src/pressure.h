@@ -0,0 +1,48 @@
+#ifndef TKMALLOC_PRESSURE_H
+#define TKMALLOC_PRESSURE_H
+
+#include <stddef.h>
+#include "malloc.h"
+
+/*
+ * Memory pressure. Every heap mapping is counted in g_mapped_bytes. With TKMALLOC_SOFT_LIMIT set, a new heap
+ * that would cross the limit is refused just like a failed mmap; either way the allocation entry point runs
+ * the pressure response (application callback, cache flush, arena trim) and retries once, this time
+ * allowed past the limit. The mapping that takes the total past PRESSURE_HIGH_WATER_PERCENT of the limit
+ * succeeds, but the entry point that made it runs the same response afterwards, so the limit is usually never
+ * reached. Only the relieving thread's (or CPU's) cache is flushed: other threads flush theirs lazily, on their
+ * next slow path after g_pressure_epoch moved; another thread's cache or an idle CPU's can't be emptied safely.
+ */
+
+#define PRESSURE_HIGH_WATER_PERCENT 90
+
+extern size_t g_mapped_bytes;
+extern unsigned long g_pressure_epoch;
+extern int g_pressure_high_water;      // a mapping crossed the high-water mark and nobody has relieved since
+
+/* count a heap mapped (or unmapped), noting when the total crosses the high-water mark */
+void pressure_account(size_t bytes, int mapped);
+
+static inline unsigned long pressure_epoch(void) {
+    return __atomic_load_n(&g_pressure_epoch, __ATOMIC_RELAXED);
+}
+
+/* whether a relief is due because the high-water mark was crossed; only one caller gets 1 per crossing */
+static inline int pressure_take_high_water(void) {
+    return __atomic_load_n(&g_pressure_high_water, __ATOMIC_RELAXED)
+        && __atomic_exchange_n(&g_pressure_high_water, 0, __ATOMIC_RELAXED);
+}
+
+/* whether an optional heap (latency mode's spare) of bytes may be mapped: never past the high-water mark */
+int pressure_may_map_spare(size_t bytes);
+
+/* whether a new heap of bytes may be mapped: always while this thread is retrying after a relief */
+int pressure_may_map(size_t bytes);
+
+/* start a relief on behalf of a want-byte request: runs the callback and bumps the epoch; 0 if this thread is already relieving */
+int pressure_begin(size_t want);
+
+/* the retry after a relief is over, the soft limit applies again */
+void pressure_end(void);
+
+#endif
@@ -0,0 +1,284 @@
+#include <errno.h>
+#include <sys/mman.h>   // for mmap
+#include <unistd.h>     // for close
+#include "debug.h"
+#include "region.h"
+
+static region_t g_regions[REGION_MAX_ATTACHED];
+static pthread_mutex_t g_regions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* offset of the first chunk header: payloads are 16-byte aligned like in a heap */
+static uint64_t region_first_off(void) {
+    return align_16(sizeof(region_hdr_t) + sizeof(chunk_prefix_t)) - sizeof(chunk_prefix_t);
+}
+
+/*
+ * 0 with the lock held. A lock whose owner died between updates is taken over; one whose owner died
+ * mid-update (busy still set) is left unrecoverable, so this and every later call fails instead of
+ * walking a torn freelist.
+ */
+static int region_lock(region_t *r) {
+    region_hdr_t *rh = region_hdr(r);
+    int rc = pthread_mutex_lock(&rh->lock);
+
+    if (rc == EOWNERDEAD) {
+        if (rh->busy) {
+            safe_log_msg("[region]: lock owner died mid-update, giving up on the region\n");
+            pthread_mutex_unlock(&rh->lock);
+            return ENOTRECOVERABLE;
+        }
+        safe_log_msg("[region]: lock owner died, recovering\n");
+        rh->recoveries++;
+        pthread_mutex_consistent(&rh->lock);
+        rc = 0;
+    }
+    return rc;
+}
+
+static void region_unlock(region_t *r) {
+    pthread_mutex_unlock(&region_hdr(r)->lock);
+}
+
+static int region_init_lock(region_hdr_t *rh) {
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int rc = pthread_mutex_init(&rh->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    return rc == 0 ? 0 : -1;
+}
+
+static int region_format(region_t *r, uint64_t magic) {
+    region_hdr_t *rh = region_hdr(r);
+
+    if (region_init_lock(rh) < 0) return -1;
+
+    rh->size = r->size;
+    rh->bump = region_first_off();
+    rh->free_list = 0;
+    rh->used = 0;
+    rh->recoveries = 0;
+    rh->root = 0;
+    rh->busy = 0;
+
+    // last: a process attaching concurrently only trusts a region once the magic is there
+    __atomic_store_n(&rh->magic, magic, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* whether r looks like a region of this kind, laid out for this size */
+static int region_valid(region_t *r, uint64_t magic) {
+    region_hdr_t *rh = region_hdr(r);
+    return __atomic_load_n(&rh->magic, __ATOMIC_ACQUIRE) == magic && rh->size == r->size
+        && rh->bump >= region_first_off() && rh->bump <= rh->size && rh->free_list < rh->bump;
+}
+
+region_t *region_attach(int fd, size_t size, uint64_t magic, int mode) {
+    if (size < region_first_off() + get_free_chunk_min_size()) return NULL;
+
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) return NULL;
+
+    region_t tmp = { (uint8_t *)mem, size, fd };
+    region_hdr_t *rh = region_hdr(&tmp);
+
+    int ok;
+
+    if (mode == REGION_FORMAT) {
+        ok = region_format(&tmp, magic) == 0;
+    }
+    else if (mode == REGION_REOPEN && rh->magic == 0 && rh->bump == 0) {
+        // never formatted: its creator died between sizing the file and laying it out
+        ok = region_format(&tmp, magic) == 0;
+    }
+    else if (mode == REGION_REOPEN) {
+        // whoever held the lock last is gone, but a change it was making when it died can't be trusted
+        ok = region_valid(&tmp, magic) && !rh->busy && region_init_lock(rh) == 0;
+    }
+    else {
+        ok = region_valid(&tmp, magic);
+    }
+
+    region_t *r = NULL;
+
+    if (ok) {
+        pthread_mutex_lock(&g_regions_lock);
+        for (int i = 0; i < REGION_MAX_ATTACHED; ++i) {
+            if (g_regions[i].base == NULL) {
+                g_regions[i] = tmp;
+                r = &g_regions[i];
+                break;
+            }
+        }
+        pthread_mutex_unlock(&g_regions_lock);
+    }
+
+    if (!r) {
+        safe_log_msg("[region]: not a region, or too many attached\n");
+        (void)munmap(mem, size);
+    }
+    return r;
+}
+
+void region_detach(region_t *r) {
+    pthread_mutex_lock(&g_regions_lock);
+    (void)munmap(r->base, r->size);
+    (void)close(r->fd);
+    r->base = NULL;
+    pthread_mutex_unlock(&g_regions_lock);
+}
+
+static void region_list_push(region_t *r, region_free_t *fc) {
+    region_hdr_t *rh = region_hdr(r);
+    region_free_t *head = region_at(r, rh->free_list);
+
+    fc->prev = 0;
+    fc->next = rh->free_list;
+    if (head) head->prev = region_off(r, fc);
+    rh->free_list = region_off(r, fc);
+}
+
+static void region_list_remove(region_t *r, region_free_t *fc) {
+    region_hdr_t *rh = region_hdr(r);
+    region_free_t *prev = region_at(r, fc->prev);
+    region_free_t *next = region_at(r, fc->next);
+
+    if (prev) prev->next = fc->next;
+    else rh->free_list = fc->next;
+    if (next) next->prev = fc->prev;
+}
+
+/* set the P bit of the chunk after hdr, unless hdr is the last one before the bump */
+static void region_set_next_P(region_t *r, void *hdr, int P) {
+    uint8_t *nxt = get_next_chunk_hdr(hdr);
+    if (region_off(r, nxt) < region_hdr(r)->bump) chunk_set_P(nxt, P);
+}
+
+void *region_alloc(region_t *r, size_t size) {
+    if (size == 0 || size > r->size) return NULL;
+
+    size_t need = chunk_need_total(size);
+    const size_t MIN_FREE = get_free_chunk_min_size();
+    uint8_t *hdr = NULL;
+
+    if (region_lock(r) != 0) return NULL;
+
+    region_hdr_t *rh = region_hdr(r);
+    rh->busy = 1;
+
+    // 1) first fit from the freelist, splitting off the rest when it can stand as a free chunk
+    for (region_free_t *fc = region_at(r, rh->free_list); fc; fc = region_at(r, fc->next)) {
+        size_t csz = chunk_get_size(fc);
+        if (csz < need) continue;
+
+        region_list_remove(r, fc);
+        hdr = (uint8_t *)fc;
+
+        if (csz >= need + MIN_FREE) {
+            chunk_write_size_to_hdr(hdr, need);
+
+            region_free_t *rem = (region_free_t *)(hdr + need);
+            rem->hdr = (csz - need) | CHUNK_HDR_P_MASK;
+            rem->heap = NULL;
+            chunk_write_ftr(rem, csz - need);
+            region_list_push(r, rem);
+        }
+        else {
+            region_set_next_P(r, hdr, 1);
+        }
+        break;
+    }
+
+    // 2) carve from the top; the chunk below the bump is always in use
+    if (!hdr && rh->size - rh->bump >= need) {
+        hdr = r->base + rh->bump;
+        *(size_t *)hdr = need | CHUNK_HDR_P_MASK;
+        rh->bump += need;
+    }
+
+    if (hdr) {
+        chunk_set_heap(hdr, NULL);
+        rh->used += chunk_get_size(hdr);
+    }
+
+    rh->busy = 0;
+    region_unlock(r);
+
+    return hdr ? chunk_hdr_to_payload(hdr) : NULL;
+}
+
+/* whether hdr is the header of a chunk handed out by r, as far as cheap checks can tell */
+static int region_owns(region_t *r, void *hdr) {
+    uint64_t off = region_off(r, hdr);
+    return (uint8_t *)hdr >= r->base && off >= region_first_off() && off < region_hdr(r)->bump
+        && is_aligned_16(chunk_hdr_to_payload(hdr));
+}
+
+void region_free(region_t *r, void *ptr) {
+    if (!ptr) return;
+
+    uint8_t *hdr = chunk_payload_to_hdr(ptr);
+
+    if (region_lock(r) != 0) return;
+
+    region_hdr_t *rh = region_hdr(r);
+
+    if (!region_owns(r, hdr)) {
+        region_unlock(r);
+        safe_log_msg("[region]: free of a pointer outside the region\n");
+        return;
+    }
+
+    size_t csz = chunk_get_size(hdr);
+    rh->busy = 1;
+    rh->used -= csz;
+
+    // merge with the right neighbor; the last chunk before the bump is always in use
+    uint8_t *nxt = hdr + csz;
+    uint64_t nxt_off = region_off(r, nxt);
+    if (nxt_off < rh->bump && nxt_off + chunk_get_size(nxt) < rh->bump && chunk_is_free(nxt)) {
+        region_list_remove(r, (region_free_t *)nxt);
+        csz += chunk_get_size(nxt);
+    }
+
+    // merge with the left neighbor
+    if (region_off(r, hdr) != region_first_off() && prev_chunk_is_free(hdr)) {
+        size_t prev_sz = chunk_get_size(hdr - sizeof(size_t));
+        hdr -= prev_sz;
+        region_list_remove(r, (region_free_t *)hdr);
+        csz += prev_sz;
+    }
+
+    chunk_write_size_to_hdr(hdr, csz);
+
+    if (region_off(r, hdr) + csz == rh->bump) {
+        rh->bump = region_off(r, hdr);
+    }
+    else {
+        chunk_write_ftr(hdr, csz);
+        region_set_next_P(r, hdr, 0);
+        region_list_push(r, (region_free_t *)hdr);
+    }
+
+    rh->busy = 0;
+    region_unlock(r);
+}
+
+int region_free_attached(void *ptr) {
+    int found = 0;
+
+    pthread_mutex_lock(&g_regions_lock);
+    for (int i = 0; i < REGION_MAX_ATTACHED && !found; ++i) {
+        region_t *r = &g_regions[i];
+        if (r->base && (uint8_t *)ptr > r->base && (uint8_t *)ptr < r->base + r->size) {
+            region_free(r, ptr);
+            found = 1;
+        }
+    }
+    pthread_mutex_unlock(&g_regions_lock);
+
+    return found;
+}
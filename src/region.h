@@ -0,0 +1,76 @@
+#ifndef TKMALLOC_REGION_H
+#define TKMALLOC_REGION_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "chunk.h"
+
+/*
+ * Regions: a single fixed-size heap inside a shared mapping (a memfd, a POSIX shm object or a file), which every
+ * process maps at a different address. All the metadata lives in the mapping and is position independent: the header
+ * and free chunk links hold offsets from the region base, never pointers. Chunks use the usual boundary tags
+ * (see chunk.h) with a NULL heap pointer, which is how free() tells them apart from heap chunks.
+ *
+ * The header's lock is a process-shared, robust mutex: if a process dies holding it, the next locker takes
+ * it over and counts a recovery. Whatever operation the dead process was in the middle of is lost.
+ */
+
+#define REGION_MAX_ATTACHED 16      // regions a process can have mapped at once
+#define REGION_SHM_MAGIC 0x746b6d73686d3031ull      // "tkmshm01"
+#define REGION_PHEAP_MAGIC 0x746b6d7068703031ull    // "tkmphp01"
+
+#define REGION_ATTACH 0     // map a region another process laid out
+#define REGION_FORMAT 1     // lay out an empty region
+#define REGION_REOPEN 2     // map a region nobody else has mapped (e.g. from a file) and reset its lock; lay it out if blank
+
+typedef struct region_hdr {
+    uint64_t magic;
+    uint64_t size;              // bytes mapped, this header included
+    pthread_mutex_t lock;       // process-shared, robust
+    uint64_t bump;              // offset of the next header carved from the top
+    uint64_t free_list;         // offset of the first free chunk, 0 for none
+    uint64_t used;              // bytes in chunks handed out
+    uint64_t recoveries;        // times the lock was taken over from a dead owner
+    uint64_t root;              // offset of the application's root object, 0 for none
+    uint32_t busy;              // set while the metadata is being changed: a torn update if seen when reopening
+} region_hdr_t;
+
+/* a free chunk, with offsets where free_chunk_t has pointers */
+typedef struct region_free {
+    size_t hdr;
+    heap_t *heap;               // always NULL
+    uint64_t prev;
+    uint64_t next;
+} region_free_t;
+
+_Static_assert(sizeof(region_free_t) == sizeof(free_chunk_t), "region chunks share the heap chunk layout");
+
+/* this process's view of a region */
+typedef struct region {
+    uint8_t *base;              // NULL for a free slot
+    size_t size;
+    int fd;
+} region_t;
+
+static inline region_hdr_t *region_hdr(region_t *r) { return (region_hdr_t *)r->base; }
+
+static inline uint64_t region_off(region_t *r, const void *p) { return (uint64_t)((const uint8_t *)p - r->base); }
+
+static inline void *region_at(region_t *r, uint64_t off) { return off ? r->base + off : NULL; }
+
+/* map size bytes of fd and register them, see REGION_ATTACH and friends for mode. NULL on failure */
+region_t *region_attach(int fd, size_t size, uint64_t magic, int mode);
+
+/* unregister and unmap; closes the fd */
+void region_detach(region_t *r);
+
+void *region_alloc(region_t *r, size_t size);
+
+/* ptr must come from region_alloc() on the same region, in any process */
+void region_free(region_t *r, void *ptr);
+
+/* free() of a chunk without a heap: release it to the attached region it lies in; 0 if there is none */
+int region_free_attached(void *ptr);
+
+#endif
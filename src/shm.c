@@ -0,0 +1,90 @@
+#include <fcntl.h>      // for O_* constants, fcntl
+#include <sys/mman.h>   // for shm_open, memfd_create
+#include <sys/stat.h>   // for fstat
+#include <unistd.h>     // for ftruncate, close
+#include "arena.h"
+#include "debug.h"
+#include "malloc.h"
+#include "region.h"
+
+/*
+ * Shared-memory heaps: a region (see region.h) in a POSIX shm object or a memfd. Processes that map it
+ * can allocate, read and free each other's objects; pointers are passed between them as offsets.
+ */
+
+static tkmalloc_shm_t *shm_attach_fd(int fd, int owned) {
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        if (owned) (void)close(fd);
+        return NULL;
+    }
+
+    // the region keeps its own descriptor, so the caller's stays theirs
+    int own = owned ? fd : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (own < 0) return NULL;
+
+    region_t *r = region_attach(own, (size_t)st.st_size, REGION_SHM_MAGIC, REGION_ATTACH);
+    if (!r) (void)close(own);
+    return r;
+}
+
+tkmalloc_shm_t *tkmalloc_shm_create(const char *name, size_t size) {
+    ensure_global_init();
+
+    size = align_pagesize(size);
+
+    int fd = name ? shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600)
+                  : memfd_create("tkmalloc-shm", MFD_CLOEXEC);
+
+    if (fd < 0) {
+        safe_log_msg("[shm_create]: failed to create the shared object\n");
+        return NULL;
+    }
+
+    region_t *r = NULL;
+    if (ftruncate(fd, (off_t)size) == 0) r = region_attach(fd, size, REGION_SHM_MAGIC, REGION_FORMAT);
+
+    if (!r) {
+        (void)close(fd);
+        if (name) (void)shm_unlink(name);
+    }
+    return r;
+}
+
+tkmalloc_shm_t *tkmalloc_shm_open(const char *name) {
+    ensure_global_init();
+
+    int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+    return fd < 0 ? NULL : shm_attach_fd(fd, 1);
+}
+
+tkmalloc_shm_t *tkmalloc_shm_open_fd(int fd) {
+    ensure_global_init();
+
+    return shm_attach_fd(fd, 0);
+}
+
+int tkmalloc_shm_fd(tkmalloc_shm_t *s) {
+    return s->fd;
+}
+
+void tkmalloc_shm_close(tkmalloc_shm_t *s) {
+    region_detach(s);
+}
+
+void *tkmalloc_shm_alloc(tkmalloc_shm_t *s, size_t size) {
+    return region_alloc(s, size);
+}
+
+void tkmalloc_shm_free(tkmalloc_shm_t *s, void *ptr) {
+    region_free(s, ptr);
+}
+
+uint64_t tkmalloc_shm_offset(tkmalloc_shm_t *s, const void *ptr) {
+    return ptr ? region_off(s, ptr) : 0;
+}
+
+void *tkmalloc_shm_ptr(tkmalloc_shm_t *s, uint64_t off) {
+    return region_at(s, off);
+}
@@ -0,0 +1,39 @@
+/* generated by tools/gen_size_classes from the linear 16-byte ladder (-l), do not edit */
+#ifndef TKMALLOC_SIZE_CLASSES_H
+#define TKMALLOC_SIZE_CLASSES_H
+
+#include <stdint.h>
+
+#define SIZE_CLASS_COUNT 64
+#define SIZE_CLASS_MAX 1040      // largest chunk size with a class
+#define SIZE_CLASS_NONE 255
+
+/* chunk size of each class */
+static const uint32_t g_size_class_size[SIZE_CLASS_COUNT] = {
+    32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208,
+    224, 240, 256, 272, 288, 304, 320, 336, 352, 368, 384, 400,
+    416, 432, 448, 464, 480, 496, 512, 528, 544, 560, 576, 592,
+    608, 624, 640, 656, 672, 688, 704, 720, 736, 752, 768, 784,
+    800, 816, 832, 848, 864, 880, 896, 912, 928, 944, 960, 976,
+    992, 1008, 1024, 1040
+};
+
+/* chunk size / 16 -> smallest class that holds it, what malloc rounds up to */
+static const uint8_t g_size_class_ceil[SIZE_CLASS_MAX / 16 + 1] = {
+    0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,
+    14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29,
+    30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45,
+    46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61,
+    62, 63
+};
+
+/* chunk size / 16 -> largest class it can serve, what free files it under; SIZE_CLASS_NONE below the first */
+static const uint8_t g_size_class_floor[SIZE_CLASS_MAX / 16 + 1] = {
+    255, 255, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,
+    14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29,
+    30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45,
+    46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61,
+    62, 63
+};
+
+#endif
@@ -13,4 +13,43 @@ typedef struct tcache_bin {
 
 static _Thread_local tcache_bin_t g_tcache[TCACHE_MAX_BINS];  // per-thread tcache
 
-#endif
\ No newline at end of file
+_Static_assert(SIZE_CLASS_COUNT <= TCACHE_MAX_BINS, "more size classes than cache bins");
+
+/*
+ * the largest size class a chunk of csz bytes can serve, -1 if not cacheable;
+ * with the built-in ladder 32->0, 48->1, 64->2 ... 1040->63
+ */
+static inline int tcache_bin_index(size_t csz) {
+    if (csz > SIZE_CLASS_MAX) return -1;
+
+    int bin = g_size_class_floor[csz / 16];
+    return bin == SIZE_CLASS_NONE ? -1 : bin;
+}
+
+static inline void* tcache_pop(int bin) {
+    tcache_bin_t *b = &g_tcache[bin];
+    free_chunk_t *fc = b->head;
+
+    if (fc == NULL) return NULL;
+
+    b->head = fc->prev;
+    b->count--;
+    return (void*)fc;
+}
+
+/* returns 0 if the bin is full */
+static inline int tcache_push(int bin, void *hdr) {
+    tcache_bin_t *b = &g_tcache[bin];
+
+    if (b->count >= TCACHE_MAX_COUNT) return 0;
+
+    // IMPORTANT: do NOT mark as free, do NOT set footer, do NOT coalesce.
+    // Chunk stays "in-use" from the global allocator's point of view.
+    free_chunk_t *fc = (free_chunk_t*)hdr;
+    fc->prev = b->head;
+    b->head = fc;
+    b->count++;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include <pthread.h>
+#include "arena.h"
+#include "debug.h"
+#include "tlab.h"
+
+_Thread_local tlab_t t_tlab = { NULL, NULL, NULL };
+
+static pthread_key_t g_tlab_key;
+static int g_tlab_key_ok = 0;
+
+/* arena lock held; the remainder becomes an ordinary in-use chunk and is released like one */
+static void tlab_retire_locked(tlab_t *t) {
+    if (t->heap && t->cur < t->end) {
+        // frees only touch the remainder's P bit under the lock, which we hold, so a plain update is safe now
+        size_t w = *(size_t*)t->cur;
+        *(size_t*)t->cur = w & ~CHUNK_HDR_TLAB_MASK;
+        heap_release_chunk(t->heap, t->cur);
+    }
+
+    t->heap = NULL;
+    t->cur = t->end = NULL;
+}
+
+static void tlab_thread_exit(void *arg) {
+    (void)arg;
+    tlab_retire();
+}
+
+void tlab_init(void) {
+    g_tlab_key_ok = (pthread_key_create(&g_tlab_key, tlab_thread_exit) == 0);
+}
+
+void *tlab_refill(arena_t *a, size_t need_total) {
+    tlab_t *t = &t_tlab;
+
+    // slices always come from the thread's own arena, so the lock we hold covers the old one too
+    if (t->heap && t->heap->arena == a) tlab_retire_locked(t);
+    if (t->heap) return NULL;
+
+    void *slice = heap_carve_from_bump(a->active_heap, TLAB_SLICE_SIZE);
+    if (!slice) return NULL;
+
+    *(size_t*)slice |= CHUNK_HDR_TLAB_MASK;
+
+    if (g_tlab_key_ok && !pthread_getspecific(g_tlab_key)) {
+        (void)pthread_setspecific(g_tlab_key, (void *)1);
+    }
+
+    t->heap = chunk_get_heap(slice);
+    t->cur = slice;
+    t->end = (uint8_t *)slice + TLAB_SLICE_SIZE;
+
+    safe_log_msg("[tlab]: reserved a new slice\n");
+    return tlab_carve(need_total);
+}
+
+void tlab_retire(void) {
+    tlab_t *t = &t_tlab;
+    if (!t->heap) return;
+
+    arena_t *a = t->heap->arena;
+
+    pthread_mutex_lock(&a->lock);
+    tlab_retire_locked(t);
+    pthread_mutex_unlock(&a->lock);
+}
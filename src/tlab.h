@@ -0,0 +1,72 @@
+#ifndef TKMALLOC_TLAB_H
+#define TKMALLOC_TLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chunk.h"
+#include "heap.h"
+
+/*
+ * Thread-local allocation buffers. Once its cache misses, a thread carves chunks of the cache size classes off the
+ * front of its own slice with no lock at all; freed ones are reused through the cache as before. A new slice of
+ * TLAB_SLICE_SIZE is reserved from the arena's bump under the lock when the old one runs out and the freelist misses.
+ *
+ * The unused rest of the slice is always a well-formed in-use chunk whose header carries CHUNK_HDR_TLAB_MASK,
+ * so coalescing never walks into it. Frees of the chunk to its left still have to clear its P bit, under the
+ * arena lock but concurrently with the owner, so that bit is only ever changed with atomic RMWs, and the owner
+ * publishes each new chunk header with a compare-and-swap that carries the P bit over. That CAS is uncontended
+ * and on a line the owner just wrote, far cheaper than the lock it replaces.
+ *
+ * The rest of a slice (0 or at least a minimal free chunk) goes back to the arena when the thread refills or exits.
+ */
+
+#define TLAB_SLICE_SIZE (size_t)(16 * 1024)     // small enough that a few threads fit in an arena's first heap
+
+typedef struct tlab {
+    heap_t *heap;       // NULL when the thread has no slice
+    uint8_t *cur;       // header of the remainder
+    uint8_t *end;
+} tlab_t;
+
+extern _Thread_local tlab_t t_tlab;
+
+/* creates the key that retires a thread's slice when it exits */
+void tlab_init(void);
+
+/* carve need_total bytes off the calling thread's slice without locking; NULL if it doesn't fit */
+static inline void *tlab_carve(size_t need_total) {
+    tlab_t *t = &t_tlab;
+    size_t rem = (size_t)(t->end - t->cur);
+
+    if (need_total > rem) return NULL;
+
+    // the remainder never shrinks below a chunk that could be freed on its own
+    size_t take = rem - need_total < get_free_chunk_min_size() ? rem : need_total;
+    uint8_t *hdr = t->cur;
+
+    if (take < rem) {
+        // not reachable by anyone until the CAS below publishes hdr's new size
+        uint8_t *next = hdr + take;
+        *(size_t*)next = (rem - take) | CHUNK_HDR_TLAB_MASK | CHUNK_HDR_P_MASK;
+        chunk_set_heap(next, t->heap);
+    }
+
+    // keep whatever P bit a free of the left neighbor left behind
+    size_t old = __atomic_load_n((size_t*)hdr, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n((size_t*)hdr, &old, take | (old & CHUNK_HDR_P_MASK), 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) { }
+
+    t->cur = hdr + take;
+
+    // used up: nothing is left to retire, and once its chunks are freed the heap may be unmapped under us
+    if (t->cur == t->end) t->heap = NULL;
+    return hdr;
+}
+
+/* retire the calling thread's slice, if it comes from a, and carve need_total bytes from a new one (a->lock held) */
+void *tlab_refill(arena_t *a, size_t need_total);
+
+/* give the rest of the calling thread's slice back to its arena (takes the arena lock) */
+void tlab_retire(void);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef TKMALLOC_TRACE_H
+#define TKMALLOC_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Static tracepoints (USDT) for perf / bpftrace, e.g.
+ *
+ *   bpftrace -e 'usdt:./build/libtkmalloc.so:tkmalloc:malloc_entry { @sizes = hist(arg0); }'
+ *   perf probe -x ./build/libtkmalloc.so sdt_tkmalloc:heap_map
+ *
+ * Built with `make USDT=1`, every probe is a single nop plus a .note.stapsdt entry describing where its
+ * arguments live; tracers patch the nop only while attached. Without USDT=1 the macros expand to nothing.
+ *
+ * The note layout is the one <sys/sdt.h> (systemtap) emits, written out here so the build does not
+ * depend on systemtap headers. Arguments are passed as 8-byte values.
+ */
+
+#ifdef TKMALLOC_USDT
+
+#define TRACE_NOTE_(name, args, ...) \
+    __asm__ __volatile__ ( \
+        "990: nop\n\t" \
+        ".pushsection .note.stapsdt, \"?\", \"note\"\n\t" \
+        ".balign 4\n\t" \
+        ".4byte 992f - 991f, 994f - 993f, 3\n\t" \
+        "991: .asciz \"stapsdt\"\n\t" \
+        "992: .balign 4\n\t" \
+        "993: .8byte 990b\n\t" \
+        ".8byte _.stapsdt.base\n\t" \
+        ".8byte 0\n\t" \
+        ".asciz \"tkmalloc\"\n\t" \
+        ".asciz \"" #name "\"\n\t" \
+        ".asciz \"" args "\"\n\t" \
+        "994: .balign 4\n\t" \
+        ".popsection\n\t" \
+        ".ifndef _.stapsdt.base\n\t" \
+        ".pushsection .stapsdt.base, \"aG\", \"progbits\", .stapsdt.base, comdat\n\t" \
+        ".weak _.stapsdt.base\n\t" \
+        ".hidden _.stapsdt.base\n\t" \
+        "_.stapsdt.base: .space 1\n\t" \
+        ".size _.stapsdt.base, 1\n\t" \
+        ".popsection\n\t" \
+        ".endif\n\t" \
+        :: __VA_ARGS__)
+
+#define TRACE_ARG_(x) "nor" ((uint64_t)(uintptr_t)(x))
+
+#define TRACE0(name)            TRACE_NOTE_(name, "", )
+#define TRACE1(name, a)         TRACE_NOTE_(name, "8@%0", TRACE_ARG_(a))
+#define TRACE2(name, a, b)      TRACE_NOTE_(name, "8@%0 8@%1", TRACE_ARG_(a), TRACE_ARG_(b))
+#define TRACE3(name, a, b, c)   TRACE_NOTE_(name, "8@%0 8@%1 8@%2", TRACE_ARG_(a), TRACE_ARG_(b), TRACE_ARG_(c))
+
+#else
+
+#define TRACE0(name)            ((void)0)
+#define TRACE1(name, a)         ((void)0)
+#define TRACE2(name, a, b)      ((void)0)
+#define TRACE3(name, a, b, c)   ((void)0)
+
+#endif
+
+#endif
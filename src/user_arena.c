@@ -0,0 +1,84 @@
+#include <sys/mman.h>   // for mmap
+#include "arena.h"
+#include "debug.h"
+#include "heap.h"
+#include "malloc.h"
+#include "numa.h"
+#include "util.h"
+
+#define USER_ARENA_ID -1
+
+/*
+ * User arenas live outside g_arenas, so the arena_t itself is mmap'd.
+ * Chunks are carved from the bump exactly like malloc() does, but they are never freed one by one:
+ * the whole region is released at once by rewinding the heaps.
+ */
+
+tkmalloc_arena_t *tkmalloc_arena_create(void) {
+    ensure_global_init();
+
+    size_t map_size = align_pagesize(sizeof(arena_t));
+    void *mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mem == MAP_FAILED) {
+        safe_log_msg("[arena_create]: failed to map arena\n");
+        return NULL;
+    }
+
+    arena_t *a = (arena_t *)mem;
+
+    // heaps go to the creating thread's node, which is presumably where the arena will be used
+    if (arena_init(a, USER_ARENA_ID, g_numa.num_nodes > 1 ? numa_current_node() : NUMA_NO_NODE) < 0) {
+        safe_log_msg("[arena_create]: failed to map first heap\n");
+        (void)munmap(mem, map_size);
+        return NULL;
+    }
+
+    return a;
+}
+
+void *tkmalloc_arena_alloc(tkmalloc_arena_t *a, size_t size) {
+    if (!a || size == 0) return NULL;
+
+    size_t need_total = chunk_need_total(size);
+
+    pthread_mutex_lock(&a->lock);
+    void *hdr = heap_carve_from_bump(a->active_heap, need_total);
+    pthread_mutex_unlock(&a->lock);
+
+    if (!hdr) {
+        safe_log_msg("[arena_alloc]: alloc failed, return NULL\n");
+        return NULL;
+    }
+
+    return chunk_hdr_to_payload(hdr);
+}
+
+void tkmalloc_arena_reset(tkmalloc_arena_t *a) {
+    if (!a) return;
+
+    pthread_mutex_lock(&a->lock);
+
+    // heaps stay mapped; heap_carve_from_bump() moves on to the next one with room as each fills up again
+    for (heap_t *h = a->heaps; h; h = h->next) {
+        h->bump = h->base;
+        h->used = 0;
+        h->draining = 0;
+    }
+
+    a->free_list = NULL;
+    for (int i = 0; i < QUICK_NUM_BINS; i++) a->quick[i] = NULL;
+    a->quick_bytes = 0;
+    a->active_heap = a->heaps;
+
+    pthread_mutex_unlock(&a->lock);
+}
+
+void tkmalloc_arena_destroy(tkmalloc_arena_t *a) {
+    if (!a) return;
+
+    arena_unmap_all_heaps(a);
+    pthread_mutex_destroy(&a->lock);
+
+    (void)munmap((void *)a, align_pagesize(sizeof(arena_t)));
+}
@@ -0,0 +1,96 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/mman.h>   // for madvise, mlock
+#include <unistd.h>     // for sysconf
+#include "arena.h"
+#include "config.h"
+#include "debug.h"
+#include "warm.h"
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23      // Linux 5.14+; older kernels fail with EINVAL and we touch the pages instead
+#endif
+
+static pthread_mutex_t g_warm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_warm_cond = PTHREAD_COND_INITIALIZER;
+static int g_warm_pending = 0;
+
+void warm_heap_memory(void *mem, size_t len) {
+    if (g_cfg.lock_heaps) {
+        if (mlock(mem, len) == 0) return;   // faults every page in as well
+        safe_log_msg("[warm]: mlock failed (RLIMIT_MEMLOCK?), prefaulting only\n");
+    }
+
+    if (madvise(mem, len, MADV_POPULATE_WRITE) == 0) return;
+
+    size_t ps = (size_t)sysconf(_SC_PAGESIZE);
+    for (size_t off = 0; off < len; off += ps) ((volatile uint8_t *)mem)[off] = 0;
+}
+
+void warm_request(void) {
+    pthread_mutex_lock(&g_warm_lock);
+    g_warm_pending = 1;
+    pthread_cond_signal(&g_warm_cond);
+    pthread_mutex_unlock(&g_warm_lock);
+}
+
+static void *warm_main(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&g_warm_lock);
+        while (!g_warm_pending) pthread_cond_wait(&g_warm_cond, &g_warm_lock);
+        g_warm_pending = 0;
+        pthread_mutex_unlock(&g_warm_lock);
+
+        for (int i = 0; i < arena_count(); i++) {
+            if (arena_fill_spare(arena_at(i))) safe_log_msg("[warm]: spare heap ready\n");
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * The thread may be filling a spare under an arena's lock when another thread forks, so fork() waits for every
+ * arena lock and ours. Arena locks come first: arena_map_new_heap() wakes the thread while holding one.
+ */
+static void warm_atfork_prepare(void) {
+    arena_lock_all();
+    pthread_mutex_lock(&g_warm_lock);
+}
+
+static void warm_atfork_parent(void) {
+    pthread_mutex_unlock(&g_warm_lock);
+    arena_unlock_all();
+}
+
+/* the thread doesn't survive fork(); the child maps its heaps on demand, still prefaulted */
+static void warm_atfork_child(void) {
+    pthread_mutex_init(&g_warm_lock, NULL);
+    pthread_cond_init(&g_warm_cond, NULL);
+    g_warm_pending = 0;
+    arena_unlock_all();
+}
+
+void warm_init(void) {
+    pthread_t t;
+    pthread_attr_t attr;
+    sigset_t all, old;
+
+    (void)pthread_atfork(warm_atfork_prepare, warm_atfork_parent, warm_atfork_child);
+
+    // keep the application's signals away from our thread
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&t, &attr, warm_main, NULL) != 0) {
+        safe_log_msg("[warm]: failed to start the spare heap thread\n");
+    }
+    pthread_attr_destroy(&attr);
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
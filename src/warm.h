@@ -0,0 +1,22 @@
+#ifndef TKMALLOC_WARM_H
+#define TKMALLOC_WARM_H
+
+#include <stddef.h>
+
+/*
+ * Latency mode (TKMALLOC_LATENCY_MODE=1). Every heap is prefaulted when it is mapped, and locked into RAM as well
+ * with TKMALLOC_LOCK_HEAPS=1, so first use of a page never faults. A background thread keeps one prefaulted spare
+ * heap per arena in use, so an arena whose heaps fill up links the spare instead of mapping in the hot path.
+ * tkmalloc_thread_prewarm() fills the calling thread's cache bins ahead of time.
+ */
+
+/* starts the spare heap thread */
+void warm_init(void);
+
+/* fault every page of a fresh mapping in, locking it too if configured */
+void warm_heap_memory(void *mem, size_t len);
+
+/* wake the spare heap thread: an arena took its spare or became ready */
+void warm_request(void);
+
+#endif
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../src/malloc.h"
+
+/* Tests for user-created arenas (tkmalloc_arena_*) */
+
+static int aligned16(void *p) {
+    return ((uintptr_t)p & 15u) == 0; 
+}
+
+static void test_alloc_and_reset(void) {
+    tkmalloc_arena_t *a = tkmalloc_arena_create();
+    assert(a);
+
+    enum { N = 10000 };
+    unsigned char *first = NULL;
+
+    for (int i = 0; i < N; ++i) {
+        size_t sz = 1 + (i % 200);
+        unsigned char *p = tkmalloc_arena_alloc(a, sz);
+        assert(p && aligned16(p));
+        memset(p, (unsigned char)i, sz);
+        if (!first) first = p;
+    }
+
+    tkmalloc_arena_reset(a);
+
+    // after a reset, allocation starts over from the base of the first heap
+    unsigned char *again = tkmalloc_arena_alloc(a, 1);
+    assert(again == first);
+
+    tkmalloc_arena_destroy(a);
+}
+
+static void test_grow_and_reuse_heaps(void) {
+    tkmalloc_arena_t *a = tkmalloc_arena_create();
+    assert(a);
+
+    // spill over into more heaps, including a large one
+    for (int i = 0; i < 40; ++i) {
+        void *p = tkmalloc_arena_alloc(a, 1024 * 1024);
+        assert(p && aligned16(p));
+        memset(p, 0xab, 1024 * 1024);
+    }
+    void *big = tkmalloc_arena_alloc(a, 16777217);
+    assert(big && aligned16(big));
+
+    tkmalloc_arena_reset(a);
+
+    for (int i = 0; i < 40; ++i) {
+        void *p = tkmalloc_arena_alloc(a, 1024 * 1024);
+        assert(p && aligned16(p));
+        memset(p, 0xcd, 1024 * 1024);
+    }
+
+    tkmalloc_arena_destroy(a);
+}
+
+static void test_edge_cases(void) {
+    assert(tkmalloc_arena_alloc(NULL, 16) == NULL);
+
+    tkmalloc_arena_t *a = tkmalloc_arena_create();
+    assert(a);
+    assert(tkmalloc_arena_alloc(a, 0) == NULL);
+
+    tkmalloc_arena_reset(NULL);
+    tkmalloc_arena_destroy(NULL);
+    tkmalloc_arena_destroy(a);
+}
+
+int main(void){
+    printf("[*] test_alloc_and_reset...\n");
+    test_alloc_and_reset();
+
+    printf("[*] test_grow_and_reuse_heaps...\n");
+    test_grow_and_reuse_heaps();
+
+    printf("[*] test_edge_cases...\n");
+    test_edge_cases();
+
+    printf("OK: all tests passed ✅\n");
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <omp.h>
+#include "../src/malloc.h"
+
+/* Tests for tkmalloc_malloc_batch / tkmalloc_free_batch */
+
+static int aligned16(void *p) {
+    return ((uintptr_t)p & 15u) == 0; 
+}
+
+static void fill_and_check(void **ptrs, size_t n, size_t sz) {
+    for (size_t i = 0; i < n; ++i) {
+        assert(ptrs[i] && aligned16(ptrs[i]));
+        memset(ptrs[i], (unsigned char)i, sz);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char *p = ptrs[i];
+        for (size_t j = 0; j < sz; ++j) assert(p[j] == (unsigned char)i);
+    }
+}
+
+static void test_batch_roundtrip(void) {
+    enum { N = 1000 };
+    void *ptrs[N];
+
+    for (size_t sz = 1; sz <= 4096; sz *= 4) {
+        size_t got = tkmalloc_malloc_batch(sz, N, ptrs);
+        assert(got == N);
+        fill_and_check(ptrs, N, sz);
+        tkmalloc_free_batch(ptrs, N);
+    }
+}
+
+static void test_batch_reuses_freed_chunks(void) {
+    enum { N = 100 };
+    void *ptrs[N];
+
+    void *big = malloc(64 * 1024);
+    assert(big);
+    free(big);  // leaves a free chunk to split
+
+    size_t got = tkmalloc_malloc_batch(2000, N, ptrs);
+    assert(got == N);
+    fill_and_check(ptrs, N, 2000);
+    tkmalloc_free_batch(ptrs, N);
+}
+
+static void test_mixed_free_batch(void) {
+    enum { N = 300 };
+    void *ptrs[N];
+
+    // mix of malloc'd and batch-allocated pointers, some NULL
+    for (size_t i = 0; i < N; ++i) {
+        ptrs[i] = (i % 7 == 0) ? NULL : malloc(1 + (i * 37) % 3000);
+    }
+    tkmalloc_free_batch(ptrs, N);
+
+    assert(tkmalloc_malloc_batch(0, 10, ptrs) == 0);
+    assert(tkmalloc_malloc_batch(16, 0, ptrs) == 0);
+    tkmalloc_free_batch(NULL, 10);
+}
+
+static void test_cross_thread_free_batch(void) {
+    enum { T = 4, N = 512 };
+    static void *ptrs[T][N];
+
+    #pragma omp parallel num_threads(T)
+    {
+        int tid = omp_get_thread_num();
+        size_t got = tkmalloc_malloc_batch(48 + tid * 100, N, ptrs[tid]);
+        assert(got == N);
+    }
+
+    // free everything from one thread: pointers belong to several arenas
+    tkmalloc_free_batch(&ptrs[0][0], (size_t)T * N);
+}
+
+int main(void){
+    printf("[*] test_batch_roundtrip...\n");
+    test_batch_roundtrip();
+
+    printf("[*] test_batch_reuses_freed_chunks...\n");
+    test_batch_reuses_freed_chunks();
+
+    printf("[*] test_mixed_free_batch...\n");
+    test_mixed_free_batch();
+
+    printf("[*] test_cross_thread_free_batch...\n");
+    test_cross_thread_free_batch();
+
+    printf("OK: all tests passed ✅\n");
+
+    return 0;
+}
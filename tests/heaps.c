@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../src/malloc.h"
+#include "../src/chunk.h"
+
+/* Tests for heap occupancy: packing into the fullest heaps and draining nearly empty ones */
+
+enum { N = 800, M = 300, SZ = 64 * 1024 };  // ~255 blocks per 16 MiB heap, so N spans three heaps or more
+
+static void *blocks[N];
+static void *more[M];
+
+static heap_t *heap_of(void *p) {
+    // through an integer, so the compiler doesn't flag reading in front of a malloc'd object
+    return chunk_get_heap((void *)((uintptr_t)p - sizeof(chunk_prefix_t)));
+}
+
+static void test_drain_and_unmap(void) {
+    tkmalloc_heap_stats_t st;
+
+    for (int i = 0; i < N; ++i) {
+        blocks[i] = malloc(SZ);
+        assert(blocks[i]);
+        memset(blocks[i], 1, SZ);
+    }
+
+    // a heap in the middle holds only our blocks and is no longer the one being carved from
+    heap_t *h = heap_of(blocks[N / 2]);
+    assert(heap_of(blocks[N - 1]) != h);
+
+    int survivor = -1;
+    for (int i = 0; i < N; ++i) {
+        if (heap_of(blocks[i]) == h) survivor = i;     // the last block carved there, right below its bump
+    }
+
+    for (int i = 0; i < N; ++i) {
+        if (i != survivor && heap_of(blocks[i]) == h) {
+            free(blocks[i]);
+            blocks[i] = NULL;
+        }
+    }
+
+    assert(tkmalloc_heap_stats(&st) == 0);
+    assert(st.draining_heaps >= 1);
+    uint64_t heaps_before = st.heaps;
+
+    // the drained heap's free space is skipped while other heaps have room at their bump,
+    // then reused rather than mapping another heap while one pinned chunk keeps it alive
+    int reused_at = -1;
+    for (int i = 0; i < M; ++i) {
+        more[i] = malloc(SZ);
+        assert(more[i]);
+        if (reused_at < 0 && heap_of(more[i]) == h) reused_at = i;
+    }
+
+    assert(reused_at > 0);
+    assert(tkmalloc_heap_stats(&st) == 0);
+    assert(st.heaps == heaps_before);
+
+    // once everything in it goes away, it is unmapped
+    for (int i = 0; i < M; ++i) {
+        if (heap_of(more[i]) == h) {
+            free(more[i]);
+            more[i] = NULL;
+        }
+    }
+    free(blocks[survivor]);
+    blocks[survivor] = NULL;
+
+    assert(tkmalloc_heap_stats(&st) == 0);
+    assert(st.heaps == heaps_before - 1);
+
+    for (int i = 0; i < N; ++i) free(blocks[i]);
+    for (int i = 0; i < M; ++i) free(more[i]);
+}
+
+static void test_reuse_freed_tail(void) {
+    enum { K = 100 };
+    tkmalloc_heap_stats_t st;
+
+    for (int i = 0; i < N; ++i) {
+        blocks[i] = malloc(SZ);
+        assert(blocks[i]);
+    }
+
+    heap_t *h = heap_of(blocks[N / 2]);
+    assert(heap_of(blocks[N - 1]) != h);
+
+    int last = -1;
+    for (int i = 0; i < N; ++i) {
+        if (heap_of(blocks[i]) == h) last = i;
+    }
+
+    // freeing the newest blocks of an older heap hands their space back to its bump
+    for (int i = last - K + 1; i <= last; ++i) {
+        assert(heap_of(blocks[i]) == h);
+        free(blocks[i]);
+    }
+
+    assert(tkmalloc_heap_stats(&st) == 0);
+    uint64_t heaps_before = st.heaps;
+
+    // which is carved again once the heaps we are carving from fill up, before any new heap is mapped
+    int got = 0;
+    while (got < M) {
+        more[got] = malloc(SZ);
+        assert(more[got]);
+        if (heap_of(more[got++]) == h) break;
+    }
+
+    assert(heap_of(more[got - 1]) == h);
+    assert(tkmalloc_heap_stats(&st) == 0);
+    assert(st.heaps == heaps_before);
+    assert(st.used_bytes <= st.mapped_bytes);
+
+    for (int i = 0; i < got; ++i) free(more[i]);
+    for (int i = last - K + 1; i <= last; ++i) blocks[i] = NULL;
+    for (int i = 0; i < N; ++i) free(blocks[i]);
+}
+
+int main(void){
+    printf("[*] test_drain_and_unmap...\n");
+    test_drain_and_unmap();
+
+    printf("[*] test_reuse_freed_tail...\n");
+    test_reuse_freed_tail();
+
+    printf("OK: all tests passed ✅\n");
+
+    return 0;
+}
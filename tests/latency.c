@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "../src/malloc.h"
+
+/*
+ * Tests for the latency histograms: a known mix of operations lands in the right path buckets, the dump can be
+ * read back from a pipe, and TKMALLOC_LATENCY_DUMP prints it at exit. In a build without `make STATS=1` the
+ * histograms must say they are compiled out instead.
+ */
+
+static tkmalloc_latency_t g_before, g_after;
+
+static uint64_t count(const uint64_t *hist) {
+    uint64_t n = 0;
+    for (int i = 0; i < TKMALLOC_LATENCY_BUCKETS; ++i) n += hist[i];
+    return n;
+}
+
+static uint64_t malloc_delta(int path) {
+    return count(g_after.malloc_hist[path]) - count(g_before.malloc_hist[path]);
+}
+
+static uint64_t free_delta(int path) {
+    return count(g_after.free_hist[path]) - count(g_before.free_hist[path]);
+}
+
+/* the whole of what tkmalloc_latency_dump() writes to a pipe, NUL-terminated */
+static size_t dump_to_buffer(char *buf, size_t cap) {
+    int fds[2];
+    assert(pipe(fds) == 0);
+
+    tkmalloc_latency_dump(fds[1]);
+    close(fds[1]);
+
+    size_t len = 0;
+    ssize_t n;
+    while (len + 1 < cap && (n = read(fds[0], buf + len, cap - 1 - len)) > 0) len += (size_t)n;
+    close(fds[0]);
+
+    buf[len] = '\0';
+    return len;
+}
+
+/* the count the dump reports for op / path, 0 if it has no line for them */
+static unsigned long long dumped_count(const char *dump, const char *op, const char *path) {
+    for (const char *line = dump; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+        char o[16], p[16];
+        unsigned long long n;
+
+        if (sscanf(line, "%15s %15s count=%llu", o, p, &n) == 3 && strcmp(o, op) == 0 && strcmp(p, path) == 0) return n;
+    }
+    return 0;
+}
+
+static void test_cache_hits(void) {
+    enum { N = 1000, SZ = 64 };
+
+    assert(tkmalloc_latency_snapshot(&g_before) == 0);
+    for (int i = 0; i < N; ++i) {
+        void *volatile p = malloc(SZ);  // volatile: the compiler may drop a malloc whose result goes unused
+        assert(p);
+        free(p);
+    }
+    assert(tkmalloc_latency_snapshot(&g_after) == 0);
+
+    // only the first malloc can miss
+    assert(malloc_delta(TKMALLOC_PATH_TCACHE) >= N - 1);
+    assert(free_delta(TKMALLOC_PATH_TCACHE) == N);
+}
+
+static void test_sized_free(void) {
+    enum { N = 16, SZ = 64 };      // below the cache's capacity: the mallocs took at least as many out of it
+    void *p[N];
+
+    for (int i = 0; i < N; ++i) {
+        p[i] = malloc(SZ);
+        assert(p[i]);
+    }
+
+    assert(tkmalloc_latency_snapshot(&g_before) == 0);
+    for (int i = 0; i < N; ++i) tkmalloc_free_sized(p[i], SZ);
+    assert(tkmalloc_latency_snapshot(&g_after) == 0);
+
+    // recorded once each, on the cache fast path
+    assert(free_delta(TKMALLOC_PATH_TCACHE) == N);
+    for (int path = 0; path < TKMALLOC_NUM_PATHS; ++path) {
+        if (path != TKMALLOC_PATH_TCACHE) assert(free_delta(path) == 0);
+    }
+}
+
+static void *carve_from_tlab(void *arg) {
+    enum { N = 64, SZ = 200 };
+    void *p[N];
+    (void)arg;
+
+    // a new thread's cache is empty, so these are carved off its slice
+    for (int i = 0; i < N; ++i) {
+        p[i] = malloc(SZ);
+        assert(p[i]);
+    }
+    for (int i = 0; i < N; ++i) free(p[i]);
+    return NULL;
+}
+
+static void test_tlab(void) {
+    pthread_t t;
+
+    assert(tkmalloc_latency_snapshot(&g_before) == 0);
+    assert(pthread_create(&t, NULL, carve_from_tlab, NULL) == 0);
+    assert(pthread_join(t, NULL) == 0);
+    assert(tkmalloc_latency_snapshot(&g_after) == 0);
+
+    assert(malloc_delta(TKMALLOC_PATH_TLAB) > 0);
+}
+
+static void test_large_and_heaps(void) {
+    enum { N = 400, SZ = 64 * 1024 };   // 25 MiB of blocks past the quick lists: more than one new heap
+    static void *p[N];
+
+    assert(tkmalloc_latency_snapshot(&g_before) == 0);
+
+    void *big = malloc(32u << 20);
+    assert(big);
+    free(big);
+
+    for (int i = 0; i < N; ++i) {
+        p[i] = malloc(SZ);
+        assert(p[i]);
+    }
+    for (int i = 0; i < N; ++i) free(p[i]);
+
+    assert(tkmalloc_latency_snapshot(&g_after) == 0);
+
+    assert(malloc_delta(TKMALLOC_PATH_LARGE) >= 1);
+    assert(free_delta(TKMALLOC_PATH_LARGE) >= 1);
+    assert(malloc_delta(TKMALLOC_PATH_HEAP) >= 1);
+    assert(free_delta(TKMALLOC_PATH_HEAP) >= 1);     // the emptied heaps were unmapped
+}
+
+static void test_dump(void) {
+    static char dump[16 * 1024];
+
+    assert(tkmalloc_latency_snapshot(&g_before) == 0);
+    assert(dump_to_buffer(dump, sizeof(dump)) > 0);
+    assert(tkmalloc_latency_snapshot(&g_after) == 0);
+
+    assert(strncmp(dump, "tkmalloc latency", 16) == 0);
+
+    // nothing was allocated in between, so the dump shows the same counts as the snapshots around it
+    unsigned long long n = dumped_count(dump, "malloc", "tcache");
+    assert(n >= count(g_before.malloc_hist[TKMALLOC_PATH_TCACHE]));
+    assert(n <= count(g_after.malloc_hist[TKMALLOC_PATH_TCACHE]));
+
+    assert(dumped_count(dump, "free", "tcache") > 0);
+    assert(dumped_count(dump, "malloc", "large") > 0);
+    assert(dumped_count(dump, "free", "heap") > 0);
+}
+
+/* run this binary again with TKMALLOC_LATENCY_DUMP set and return what it printed to stderr */
+static void run_with_dump_at_exit(char **argv, char *buf, size_t cap) {
+    int fds[2];
+    assert(pipe(fds) == 0);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+
+    if (pid == 0) {
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        setenv("TKMALLOC_LATENCY_DUMP", "1", 1);
+        setenv("TKMALLOC_TEST_LATENCY_STAGE", "dump-at-exit", 1);
+        execv("/proc/self/exe", argv);
+        _exit(127);
+    }
+
+    close(fds[1]);
+
+    size_t len = 0;
+    ssize_t n;
+    while (len + 1 < cap && (n = read(fds[0], buf + len, cap - 1 - len)) > 0) len += (size_t)n;
+    close(fds[0]);
+    buf[len] = '\0';
+
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static void test_dump_at_exit(char **argv) {
+    static char out[16 * 1024];
+
+    run_with_dump_at_exit(argv, out, sizeof(out));
+
+    assert(strstr(out, "tkmalloc latency") != NULL);
+    assert(dumped_count(strstr(out, "tkmalloc latency"), "malloc", "tcache") > 0);
+}
+
+static void test_compiled_out(char **argv) {
+    static char out[16 * 1024];
+    tkmalloc_latency_t snap;
+
+    assert(tkmalloc_latency_snapshot(&snap) == -1);
+
+    assert(dump_to_buffer(out, sizeof(out)) > 0);
+    assert(strstr(out, "STATS=1") != NULL);
+
+    // and nothing is printed at exit
+    run_with_dump_at_exit(argv, out, sizeof(out));
+    assert(strstr(out, "tkmalloc latency") == NULL);
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+
+    if (getenv("TKMALLOC_TEST_LATENCY_STAGE")) {
+        // stage 2: allocate a little, the dump is written when we exit
+        for (int i = 0; i < 100; ++i) {
+            void *volatile p = malloc(64);
+            assert(p);
+            free(p);
+        }
+        return 0;
+    }
+
+    tkmalloc_latency_t snap;
+
+    if (tkmalloc_latency_snapshot(&snap) < 0) {
+        printf("[*] test_compiled_out...\n");
+        test_compiled_out(argv);
+
+        printf("OK: all tests passed ✅\n");
+        return 0;
+    }
+
+    if (!getenv("TKMALLOC_DISABLE_TCACHE")) {
+        printf("[*] test_cache_hits...\n");
+        test_cache_hits();
+
+        printf("[*] test_sized_free...\n");
+        test_sized_free();
+    }
+
+    if (!getenv("TKMALLOC_DISABLE_TLAB")) {
+        printf("[*] test_tlab...\n");
+        test_tlab();
+    }
+
+    printf("[*] test_large_and_heaps...\n");
+    test_large_and_heaps();
+
+    if (!getenv("TKMALLOC_DISABLE_TCACHE")) {
+        printf("[*] test_dump...\n");
+        test_dump();
+
+        printf("[*] test_dump_at_exit...\n");
+        test_dump_at_exit(argv);
+    }
+
+    printf("OK: all tests passed ✅\n");
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "../src/malloc.h"
+
+/*
+ * Tests for latency mode: prefaulted heaps, the background spare heap and cache prewarming.
+ * The mode is read once at startup, so the test re-executes itself with TKMALLOC_LATENCY_MODE set.
+ */
+
+static long thread_minor_faults(void) {
+    struct rusage ru;
+    assert(getrusage(RUSAGE_THREAD, &ru) == 0);
+    return ru.ru_minflt;
+}
+
+/* the spare heap is mapped by a background thread; give it a moment */
+static int wait_for_spare(void) {
+    tkmalloc_heap_stats_t st;
+
+    for (int i = 0; i < 500; ++i) {
+        assert(tkmalloc_heap_stats(&st) == 0);
+        if (st.spare_heaps > 0) return 1;
+        usleep(10 * 1000);
+    }
+    return 0;
+}
+
+static void test_prewarm(void) {
+    enum { PER_CLASS = 8 };
+    tkmalloc_heap_stats_t before, after;
+    void *p[PER_CLASS];
+
+    size_t cached = tkmalloc_thread_prewarm(PER_CLASS);
+    assert(cached > 0);
+
+    // every size up to the largest class is now served from the cache, without carving anything new
+    assert(tkmalloc_heap_stats(&before) == 0);
+    for (size_t size = 16; size <= 1024; size += 16) {
+        for (int i = 0; i < PER_CLASS; ++i) {
+            p[i] = malloc(size);
+            assert(p[i]);
+        }
+        assert(tkmalloc_heap_stats(&after) == 0);
+        assert(after.used_bytes == before.used_bytes);
+        for (int i = 0; i < PER_CLASS; ++i) free(p[i]);
+    }
+}
+
+static void test_spare_heap(void) {
+    enum { N = 64, SZ = 64 * 1024 };    // 4 MiB: past the small first heap, so the spare is linked
+    tkmalloc_heap_stats_t before, after;
+    void *p[N];
+
+    assert(wait_for_spare());
+    assert(tkmalloc_heap_stats(&before) == 0);
+
+    // the new heap is already there and faulted in: touching all of it costs next to no page faults
+    long faults = thread_minor_faults();
+    for (int i = 0; i < N; ++i) {
+        p[i] = malloc(SZ);
+        assert(p[i]);
+        memset(p[i], i, SZ);
+    }
+    faults = thread_minor_faults() - faults;
+
+    assert(tkmalloc_heap_stats(&after) == 0);
+    assert(after.heaps > before.heaps);
+    assert(faults < N * SZ / 4096 / 8);
+
+    // and another one is on its way
+    assert(wait_for_spare());
+
+    for (int i = 0; i < N; ++i) free(p[i]);
+}
+
+static void test_fork_while_filling(void) {
+    enum { ROUNDS = 20, N = 64, SZ = 256 * 1024 };     // 16 MiB a round: every round takes the spare
+    static void *p[ROUNDS][N];
+
+    // each round wakes the spare heap thread, and the fork lands while it may be holding an arena's lock
+    for (int r = 0; r < ROUNDS; ++r) {
+        for (int i = 0; i < N; ++i) {
+            p[r][i] = malloc(SZ);
+            assert(p[r][i]);
+        }
+
+        pid_t pid = fork();
+        assert(pid >= 0);
+
+        if (pid == 0) {
+            alarm(10);      // a child stuck on an inherited lock dies of SIGALRM instead
+            void *volatile q = malloc(64 * 1024);
+            free(q);
+            _exit(q ? 0 : 1);
+        }
+
+        int status;
+        assert(waitpid(pid, &status, 0) == pid);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    for (int r = 0; r < ROUNDS; ++r) {
+        for (int i = 0; i < N; ++i) free(p[r][i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+
+    if (!getenv("TKMALLOC_LATENCY_MODE")) {
+        setenv("TKMALLOC_LATENCY_MODE", "1", 1);
+        execv("/proc/self/exe", argv);
+        perror("execv");
+        return 1;
+    }
+
+    printf("[*] test_spare_heap...\n");
+    test_spare_heap();
+
+    printf("[*] test_prewarm...\n");
+    test_prewarm();
+
+    printf("[*] test_fork_while_filling...\n");
+    test_fork_while_filling();
+
+    printf("OK: all tests passed ✅\n");
+
+    return 0;
+}
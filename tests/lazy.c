@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "../src/malloc.h"
+
+/* Tests for lazy arena creation: only arenas that threads were assigned to have heaps, and those start small */
+
+enum { THREADS = 4 };
+
+static pthread_barrier_t g_barrier;
+
+static void *worker(void *arg) {
+    (void)arg;
+    void *p = malloc(100);
+    assert(p);
+    pthread_barrier_wait(&g_barrier);   // hold on until main has counted the heaps
+    pthread_barrier_wait(&g_barrier);
+    free(p);
+    return NULL;
+}
+
+static void test_startup_footprint(void) {
+    tkmalloc_heap_stats_t st;
+
+    void *p = malloc(100);
+    assert(p);
+
+    // the main thread's arena and nothing else, however many CPUs there are
+    assert(tkmalloc_heap_stats(&st) == 0);
+    assert(st.heaps == 1);
+    assert(st.mapped_bytes <= 1024 * 1024);
+
+    free(p);
+}
+
+static void test_arenas_on_demand(void) {
+    tkmalloc_heap_stats_t before, during;
+    pthread_t t[THREADS];
+
+    assert(tkmalloc_heap_stats(&before) == 0);
+
+    pthread_barrier_init(&g_barrier, NULL, THREADS + 1);
+    for (int i = 0; i < THREADS; ++i) pthread_create(&t[i], NULL, worker, NULL);
+    pthread_barrier_wait(&g_barrier);
+
+    // at most one new small heap per thread
+    assert(tkmalloc_heap_stats(&during) == 0);
+    assert(during.heaps <= before.heaps + THREADS);
+    assert(during.mapped_bytes <= before.mapped_bytes + THREADS * 1024 * 1024);
+
+    pthread_barrier_wait(&g_barrier);
+    for (int i = 0; i < THREADS; ++i) pthread_join(t[i], NULL);
+    pthread_barrier_destroy(&g_barrier);
+}
+
+static void test_growth_past_first_heap(void) {
+    enum { N = 64, SZ = 16 * 1024 };    // 1 MiB, more than the first heap holds
+    void *p[N];
+
+    for (int i = 0; i < N; ++i) {
+        p[i] = malloc(SZ);
+        assert(p[i]);
+        memset(p[i], i, SZ);
+    }
+    for (int i = 0; i < N; ++i) {
+        for (int j = 0; j < SZ; j += 512) assert(((unsigned char *)p[i])[j] == (unsigned char)i);
+        free(p[i]);
+    }
+}
+
+int main(void){
+    printf("[*] test_startup_footprint...\n");
+    test_startup_footprint();
+
+    printf("[*] test_arenas_on_demand...\n");
+    test_arenas_on_demand();
+
+    printf("[*] test_growth_past_first_heap...\n");
+    test_growth_past_first_heap();
+
+    printf("OK: all tests passed ✅\n");
+
+    return 0;
+}
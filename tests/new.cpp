@@ -0,0 +1,97 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include "../src/malloc.h"
+
+/* Tests for the C++ operator new / delete overrides and the aligned / sized C entry points */
+
+static bool aligned_to(const void *p, std::size_t a) {
+    return (reinterpret_cast<std::uintptr_t>(p) & (a - 1)) == 0;
+}
+
+struct alignas(64) CacheLine {
+    char bytes[64];
+};
+
+struct alignas(4096) Page {
+    char bytes[100];
+};
+
+static void test_plain_and_sized(void) {
+    for (int round = 0; round < 1000; ++round) {
+        int *x = new int(round);
+        assert(*x == round);
+        delete x;   // sized delete with -fsized-deallocation (default in C++14)
+
+        char *arr = new char[1 + round % 900];
+        std::memset(arr, 'a', 1 + round % 900);
+        delete[] arr;
+    }
+
+    std::vector<std::string> v;
+    for (int i = 0; i < 10000; ++i) v.push_back(std::string(1 + i % 200, 'x'));
+    assert(v.size() == 10000 && v[9999].size() == 1 + 9999 % 200);
+}
+
+static void test_aligned(void) {
+    std::vector<CacheLine *> lines;
+    for (int i = 0; i < 1000; ++i) {
+        CacheLine *c = new CacheLine();
+        assert(aligned_to(c, 64));
+        std::memset(c->bytes, i, sizeof(c->bytes));
+        lines.push_back(c);
+    }
+    for (CacheLine *c : lines) delete c;
+
+    Page *p = new Page[3];
+    assert(aligned_to(p, 4096));
+    delete[] p;
+
+    auto up = std::make_unique<Page>();
+    assert(aligned_to(up.get(), 4096));
+
+    // large aligned request gets its own heap
+    void *big = tkmalloc_aligned_alloc(1 << 20, 20u << 20);
+    assert(big && aligned_to(big, 1 << 20));
+    std::memset(big, 1, 20u << 20);
+    free(big);
+
+    assert(tkmalloc_aligned_alloc(48, 16) == nullptr);   // not a power of two
+}
+
+static void test_nothrow(void) {
+    int *x = new (std::nothrow) int(7);
+    assert(x && *x == 7);
+    delete x;
+
+    CacheLine *c = new (std::nothrow) CacheLine();
+    assert(c && aligned_to(c, 64));
+    delete c;
+
+    // zero-byte new still yields a unique pointer
+    char *z1 = new char[0];
+    char *z2 = new char[0];
+    assert(z1 && z2 && z1 != z2);
+    delete[] z1;
+    delete[] z2;
+}
+
+int main(void) {
+    std::printf("[*] test_plain_and_sized...\n");
+    test_plain_and_sized();
+
+    std::printf("[*] test_aligned...\n");
+    test_aligned();
+
+    std::printf("[*] test_nothrow...\n");
+    test_nothrow();
+
+    std::printf("OK: all tests passed ✅\n");
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include "../src/malloc.h"
+
+/*
+ * Tests for NUMA-aware arenas under a fake sysfs topology.
+ * The topology is read once at startup, so the test writes it out and re-executes itself
+ * with TKMALLOC_NUMA_SYSFS_ROOT pointing at it.
+ */
+
+static void write_file(const char *dir, const char *name, const char *content) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    fputs(content, f);
+    fclose(f);
+}
+
+static void make_fake_topology(char *root, const char *online, const char *cpus0, const char *cpus1) {
+    char dir[512];
+
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    write_file(root, "online", online);
+
+    snprintf(dir, sizeof(dir), "%s/node0", root);
+    mkdir(dir, 0755);
+    write_file(dir, "cpulist", cpus0);
+
+    snprintf(dir, sizeof(dir), "%s/node1", root);
+    mkdir(dir, 0755);
+    write_file(dir, "cpulist", cpus1);
+}
+
+/* the topology was read at startup; nothing leaks into /tmp */
+static void remove_fake_topology(const char *root) {
+    char path[512];
+    const char *files[] = { "node0/cpulist", "node1/cpulist", "node0", "node1", "online" };
+
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+        snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+        remove(path);
+    }
+    rmdir(root);
+}
+
+/* arenas per node as global_init() splits them: in proportion to CPUs, at least one per node with CPUs */
+static int expected_arenas(int cpus_on_node, int total_cpus) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    if (n > 64) n = 64;
+
+    int want = cpus_on_node * (int)n / total_cpus;
+    return want < 1 ? 1 : want;
+}
+
+static void test_two_node_layout(void) {
+    tkmalloc_numa_stats_t st;
+
+    void *p = malloc(100);
+    assert(p);
+    assert(tkmalloc_numa_stats(&st) == 0);
+
+    // node 0 has CPU 0, node 1 has CPUs 1-7
+    assert(st.nodes == 2);
+    assert(st.arenas[0] == expected_arenas(1, 8));
+    assert(st.arenas[1] == expected_arenas(7, 8));
+
+    // the thread got an arena on the node of the CPU it runs on (CPUs the topology doesn't list count as node 0)
+    int cpu = sched_getcpu();
+    int node = (cpu >= 1 && cpu <= 7) ? 1 : 0;
+    assert(st.thread_node == node);
+    assert(st.heaps[node] >= 1);
+
+    free(p);
+}
+
+static void *stats_before_malloc(void *arg) {
+    tkmalloc_numa_stats_t *st = arg;
+
+    // asking must not assign an arena (or map its first heap) as a side effect
+    assert(tkmalloc_numa_stats(&st[0]) == 0);
+
+    void *volatile p = malloc(100);     // volatile: the compiler may drop a malloc whose result goes unused
+    assert(p);
+    free(p);
+
+    assert(tkmalloc_numa_stats(&st[1]) == 0);
+    return NULL;
+}
+
+static void test_stats_assign_nothing(void) {
+    tkmalloc_numa_stats_t st[2];
+    pthread_t t;
+
+    assert(pthread_create(&t, NULL, stats_before_malloc, st) == 0);
+    assert(pthread_join(t, NULL) == 0);
+
+    assert(st[0].thread_node == -1);
+    assert(st[1].thread_node >= 0);
+}
+
+static void test_malformed_layout(void) {
+    tkmalloc_numa_stats_t st;
+
+    void *p = malloc(100);
+    assert(p);
+    assert(tkmalloc_numa_stats(&st) == 0);
+
+    // a single unbound node with every arena
+    assert(st.nodes == 1);
+    assert(st.thread_node == -1);
+    assert(st.arenas[0] == expected_arenas(1, 1));
+    assert(st.arenas[1] == 0);
+
+    free(p);
+}
+
+static int run_workload(void) {
+    const int nthreads = 4;
+    int errors = 0;
+
+    #pragma omp parallel num_threads(nthreads) reduction(+:errors)
+    {
+        int tid = omp_get_thread_num();
+
+        for (size_t i = 0; i < 5000; i++) {
+            size_t sz = 16 + ((i + tid) % 4000);
+            unsigned char *p = malloc(sz);
+
+            if (!p) {
+                errors++;
+                break;
+            }
+
+            memset(p, tid + 1, sz);
+            if (p[sz - 1] != (unsigned char)(tid + 1)) errors++;
+
+            free(p);
+        }
+    }
+
+    return errors;
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+
+    const char *stage = getenv("TKMALLOC_TEST_NUMA_STAGE");
+
+    if (!stage) {
+        // stage 1: two nodes, node 1 has most CPUs (binding to it fails on non-NUMA boxes and must be ignored)
+        static char root[] = "/tmp/tkmalloc-numa-XXXXXX";
+        make_fake_topology(root, "0-1\n", "0\n", "1-7\n");
+        setenv("TKMALLOC_NUMA_SYSFS_ROOT", root, 1);
+        setenv("TKMALLOC_TEST_NUMA_STAGE", "two-nodes", 1);
+        fflush(stdout);
+        execv("/proc/self/exe", argv);
+        perror("execv");
+        return 1;
+    }
+
+    free(malloc(1));    // make sure the topology has been read before it goes
+    remove_fake_topology(getenv("TKMALLOC_NUMA_SYSFS_ROOT"));
+
+    if (strcmp(stage, "two-nodes") == 0) {
+        printf("[*] test_two_node_layout...\n");
+        test_two_node_layout();
+
+        printf("[*] test_stats_assign_nothing...\n");
+        test_stats_assign_nothing();
+
+        printf("[*] test_fake_two_nodes...\n");
+        if (run_workload() != 0) {
+            printf("FAILED: fake two-node topology\n");
+            return 1;
+        }
+
+        // stage 2: garbage topology must degrade to a single node
+        static char root[] = "/tmp/tkmalloc-numa-XXXXXX";
+        make_fake_topology(root, "0-x\n", "junk\n", "\n");
+        setenv("TKMALLOC_NUMA_SYSFS_ROOT", root, 1);
+        setenv("TKMALLOC_TEST_NUMA_STAGE", "malformed", 1);
+        fflush(stdout);
+        execv("/proc/self/exe", argv);
+        perror("execv");
+        return 1;
+    }
+
+    printf("[*] test_malformed_layout...\n");
+    test_malformed_layout();
+
+    printf("[*] test_malformed_topology...\n");
+    if (run_workload() != 0) {
+        printf("FAILED: malformed topology\n");
+        return 1;
+    }
+
+    if (strcmp(stage, "malformed") == 0) {
+        // stage 3: ids past what int (or the tables) hold, and a range that would take forever to walk
+        static char root[] = "/tmp/tkmalloc-numa-XXXXXX";
+        make_fake_topology(root, "0-1\n", "0-99999999999999999999\n", "1-2147483647\n");
+        setenv("TKMALLOC_NUMA_SYSFS_ROOT", root, 1);
+        setenv("TKMALLOC_TEST_NUMA_STAGE", "huge-ids", 1);
+        fflush(stdout);
+        execv("/proc/self/exe", argv);
+        perror("execv");
+        return 1;
+    }
+
+    printf("OK: all tests passed ✅\n");
+    return 0;
+}
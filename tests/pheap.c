@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/wait.h>
+#include "../src/malloc.h"
+#include "../src/region.h"
+
+/* Tests for file-backed persistent heaps: state survives a restart, the file is exclusive, blank files are formatted, torn files are refused */
+
+#define MiB ((size_t)1 << 20)
+
+typedef struct node {
+    uint64_t next;      // offset of the next node, 0 at the end
+    uint64_t value;
+} node_t;
+
+typedef struct root {
+    uint64_t head;
+    uint64_t count;
+} root_t;
+
+static char g_path[64];
+
+static void new_heap_file(void) {
+    strcpy(g_path, "/tmp/tkmalloc-pheap-XXXXXX");
+    int fd = mkstemp(g_path);
+    assert(fd >= 0);
+    close(fd);
+}
+
+static void build_list(uint64_t n) {
+    tkmalloc_pheap_t *p = tkmalloc_pheap_open(g_path, 4 * MiB);
+    assert(p);
+
+    root_t *root = tkmalloc_pheap_alloc(p, sizeof(*root));
+    assert(root);
+    root->head = 0;
+    root->count = n;
+
+    for (uint64_t i = 0; i < n; ++i) {
+        node_t *nd = tkmalloc_pheap_alloc(p, sizeof(*nd));
+        assert(nd);
+        nd->value = n - 1 - i;
+        nd->next = root->head;
+        root->head = tkmalloc_pheap_offset(p, nd);
+    }
+
+    tkmalloc_pheap_set_root(p, root);
+    tkmalloc_pheap_close(p);
+}
+
+static void check_list(tkmalloc_pheap_t *p, uint64_t n) {
+    root_t *root = tkmalloc_pheap_root(p);
+    assert(root && root->count == n);
+
+    uint64_t i = 0;
+    for (node_t *nd = tkmalloc_pheap_ptr(p, root->head); nd; nd = tkmalloc_pheap_ptr(p, nd->next)) {
+        assert(nd->value == i++);
+    }
+    assert(i == n);
+}
+
+static void test_warm_restart(void) {
+    enum { N = 1000 };
+
+    new_heap_file();
+
+    // the heap is built by a process that is gone by the time we reopen it
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        build_list(N);
+        _exit(0);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    tkmalloc_pheap_t *p = tkmalloc_pheap_open(g_path, 0);
+    assert(p);
+    check_list(p, N);
+
+    // new allocations land in free space, not on top of the restored objects
+    void *fresh[N];
+    for (int i = 0; i < N; ++i) {
+        fresh[i] = tkmalloc_pheap_alloc(p, sizeof(node_t));
+        assert(fresh[i]);
+        memset(fresh[i], 0xff, sizeof(node_t));
+    }
+    check_list(p, N);
+
+    // freed space is remembered across a restart as well
+    uint64_t hole = tkmalloc_pheap_offset(p, fresh[N / 2]);
+    tkmalloc_pheap_free(p, fresh[N / 2]);
+    tkmalloc_pheap_close(p);
+
+    p = tkmalloc_pheap_open(g_path, 0);
+    assert(p);
+    assert(tkmalloc_pheap_offset(p, tkmalloc_pheap_alloc(p, sizeof(node_t))) == hole);
+    tkmalloc_pheap_close(p);
+
+    unlink(g_path);
+}
+
+static void test_one_process_at_a_time(void) {
+    new_heap_file();
+
+    tkmalloc_pheap_t *p = tkmalloc_pheap_open(g_path, MiB);
+    assert(p);
+    assert(tkmalloc_pheap_open(g_path, MiB) == NULL);
+    tkmalloc_pheap_close(p);
+
+    p = tkmalloc_pheap_open(g_path, MiB);
+    assert(p);
+    tkmalloc_pheap_close(p);
+
+    unlink(g_path);
+}
+
+static void test_formats_blank_file(void) {
+    new_heap_file();
+
+    // the creator died after sizing the file but before laying out the heap
+    assert(truncate(g_path, (off_t)MiB) == 0);
+
+    tkmalloc_pheap_t *p = tkmalloc_pheap_open(g_path, MiB);
+    assert(p);
+    assert(tkmalloc_pheap_root(p) == NULL);
+    tkmalloc_pheap_close(p);
+
+    build_list(10);
+
+    p = tkmalloc_pheap_open(g_path, MiB);
+    assert(p);
+    check_list(p, 10);
+    tkmalloc_pheap_close(p);
+
+    unlink(g_path);
+}
+
+static void test_refuses_bad_files(void) {
+    new_heap_file();
+
+    // a heap whose last user died in the middle of an update
+    tkmalloc_pheap_t *p = tkmalloc_pheap_open(g_path, MiB);
+    assert(p);
+    region_hdr(p)->busy = 1;
+    tkmalloc_pheap_close(p);
+
+    errno = 0;
+    assert(tkmalloc_pheap_open(g_path, MiB) == NULL);
+    assert(errno == EUCLEAN);
+
+    // not a heap at all
+    FILE *f = fopen(g_path, "w");
+    assert(f);
+    fputs("just some text", f);
+    fclose(f);
+
+    errno = 0;
+    assert(tkmalloc_pheap_open(g_path, MiB) == NULL);
+    assert(errno == EUCLEAN);
+
+    unlink(g_path);
+}
+
+int main(void){
+    printf("[*] test_warm_restart...\n");
+    test_warm_restart();
+
+    printf("[*] test_one_process_at_a_time...\n");
+    test_one_process_at_a_time();
+
+    printf("[*] test_formats_blank_file...\n");
+    test_formats_blank_file();
+
+    printf("[*] test_refuses_bad_files...\n");
+    test_refuses_bad_files();
+
+    printf("OK: all tests passed ✅\n");
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include "../src/malloc.h"
+
+/*
+ * Tests for the soft memory limit and the pressure callback.
+ * The limit is read once at startup, so the test measures what the arenas map up front and
+ * re-executes itself with TKMALLOC_SOFT_LIMIT a few heaps above that; a second stage gets a limit
+ * far enough above that for the high-water mark to come a few heaps before it.
+ */
+
+#define MiB ((size_t)1 << 20)
+#define HEAP_SIZE (16 * MiB)
+
+enum { CACHED = 24, WORK = 24 };     // both together need four 16 MiB heaps, either alone two
+
+static void *app_cache[CACHED];     // stands in for an application-level cache the callback can shed
+static int callbacks = 0;
+static size_t last_want = 0;
+
+static void shed_cache(size_t want, void *arg) {
+    (void)arg;
+    callbacks++;
+    last_want = want;
+    for (int i = 0; i < CACHED; ++i) {
+        free(app_cache[i]);
+        app_cache[i] = NULL;
+    }
+}
+
+static volatile size_t mapped_when_called = 0;    // volatile: the compiler assumes malloc leaves it alone
+
+static void note_mapped(size_t want, void *arg) {
+    (void)want;
+    (void)arg;
+    if (!mapped_when_called) mapped_when_called = tkmalloc_mapped_bytes();
+}
+
+static void test_relief_before_limit(size_t limit) {
+    enum { N = 256 };
+    static void *p[N];
+    int i;
+
+    tkmalloc_set_pressure_callback(note_mapped, NULL);
+
+    // grow until the callback runs; it must come once past 90% of the limit, while a heap still fits under it
+    for (i = 0; i < N && !mapped_when_called; ++i) {
+        p[i] = malloc(MiB);
+        assert(p[i]);
+    }
+
+    assert(mapped_when_called >= limit / 100 * 90);
+    assert(mapped_when_called + HEAP_SIZE <= limit);
+
+    while (i-- > 0) free(p[i]);
+    tkmalloc_set_pressure_callback(NULL, NULL);
+}
+
+static void test_callback_makes_room(size_t limit) {
+    void *work[WORK];
+
+    tkmalloc_set_pressure_callback(shed_cache, NULL);
+
+    for (int i = 0; i < CACHED; ++i) {
+        app_cache[i] = malloc(MiB);
+        assert(app_cache[i]);
+        memset(app_cache[i], 1, MiB);
+    }
+
+    // more than fits under the limit next to the cache: the callback has to run, and what it frees is reused
+    for (int i = 0; i < WORK; ++i) {
+        work[i] = malloc(MiB);
+        assert(work[i]);
+        memset(work[i], 2, MiB);
+    }
+
+    assert(callbacks >= 1);
+    assert(last_want == MiB);
+    assert(tkmalloc_mapped_bytes() <= limit);
+
+    for (int i = 0; i < WORK; ++i) free(work[i]);
+    tkmalloc_set_pressure_callback(NULL, NULL);
+}
+
+static void test_limit_is_soft(size_t limit) {
+    enum { N = 64 };
+    void *p[N];
+
+    // nothing left to shed: allocations still succeed, past the limit
+    for (int i = 0; i < N; ++i) {
+        p[i] = malloc(MiB);
+        assert(p[i]);
+    }
+
+    assert(tkmalloc_mapped_bytes() > limit);
+
+    for (int i = 0; i < N; ++i) free(p[i]);
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+
+    const char *limit_env = getenv("TKMALLOC_SOFT_LIMIT");
+    const char *stage = getenv("TKMALLOC_TEST_PRESSURE_STAGE");
+
+    if (!limit_env) {
+        // room for three more heaps on top of what the arenas mapped at startup, or eleven for the high-water stage
+        size_t limit_mib = (tkmalloc_mapped_bytes() + MiB - 1) / MiB + (stage ? 176 : 48);
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%zuM", limit_mib);
+        setenv("TKMALLOC_SOFT_LIMIT", buf, 1);
+        fflush(stdout);
+        execv("/proc/self/exe", argv);
+        perror("execv");
+        return 1;
+    }
+
+    size_t limit = (size_t)strtoull(limit_env, NULL, 10) * MiB;
+
+    if (stage) {
+        printf("[*] test_relief_before_limit...\n");
+        test_relief_before_limit(limit);
+
+        printf("OK: all tests passed ✅\n");
+        return 0;
+    }
+
+    printf("[*] test_callback_makes_room...\n");
+    test_callback_makes_room(limit);
+
+    printf("[*] test_limit_is_soft...\n");
+    test_limit_is_soft(limit);
+
+    // stage 2 measures its own startup and sets its own limit
+    unsetenv("TKMALLOC_SOFT_LIMIT");
+    setenv("TKMALLOC_TEST_PRESSURE_STAGE", "high-water", 1);
+    fflush(stdout);
+    execv("/proc/self/exe", argv);
+    perror("execv");
+    return 1;
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../src/malloc.h"
+#include "../src/arena.h"
+
+/* Tests for deferred coalescing (quick lists) and its counters */
+
+// a chunk past the cache size classes (whichever table the library was built with) and within the quick lists
+#define CHUNK (SIZE_CLASS_MAX + 64 < QUICK_MAX_SIZE ? SIZE_CLASS_MAX + 64 : QUICK_MAX_SIZE)
+
+enum { N = 50, SZ = CHUNK - 16 };    // N * SZ under the consolidation threshold
+
+static void test_reuse_without_merge(void) {
+    tkmalloc_quick_stats_t before, after;
+    void *ptrs[N];
+
+    assert(tkmalloc_quick_stats(&before) == 0);
+
+    for (int i = 0; i < N; ++i) {
+        ptrs[i] = malloc(SZ);
+        assert(ptrs[i]);
+        memset(ptrs[i], i, SZ);
+    }
+    void *guard = malloc(SZ);   // keep the chunks away from the bump so they can't just shrink it
+    for (int i = 0; i < N; ++i) free(ptrs[i]);
+
+    for (int i = 0; i < N; ++i) {
+        ptrs[i] = malloc(SZ);
+        assert(ptrs[i]);
+        memset(ptrs[i], i, SZ);
+    }
+
+    assert(tkmalloc_quick_stats(&after) == 0);
+    assert(after.deferred_frees - before.deferred_frees >= N);
+    assert(after.reused_chunks - before.reused_chunks >= N);
+
+    for (int i = 0; i < N; ++i) free(ptrs[i]);
+    free(guard);
+}
+
+static void test_no_merge_while_bump_has_room(void) {
+    tkmalloc_quick_stats_t before, after;
+    void *ptrs[N];
+
+    for (int i = 0; i < N; ++i) ptrs[i] = malloc(SZ);
+    void *guard = malloc(SZ);
+
+    assert(tkmalloc_quick_stats(&before) == 0);
+    for (int i = 0; i < N; ++i) free(ptrs[i]);
+
+    // a size nothing was parked for, but the bump still has room: the parked chunks stay parked
+    void *other = malloc(SZ / 2);
+    assert(other);
+
+    assert(tkmalloc_quick_stats(&after) == 0);
+    assert(after.deferred_frees - before.deferred_frees == N);
+    assert(after.consolidations == before.consolidations);
+
+    free(other);
+    free(guard);
+}
+
+static void test_consolidation(void) {
+    enum { M = QUICK_CONSOLIDATE_BYTES / CHUNK + 16 };      // past the consolidation threshold
+    tkmalloc_quick_stats_t before, after;
+    void *ptrs[M];
+
+    assert(tkmalloc_quick_stats(&before) == 0);
+
+    for (int i = 0; i < M; ++i) ptrs[i] = malloc(SZ);
+    for (int i = 0; i < M; ++i) free(ptrs[i]);
+
+    // a size nothing was parked for: forces a miss, served after merging
+    void *big = malloc(64 * 1024);
+    assert(big);
+    memset(big, 0xab, 64 * 1024);
+    free(big);
+
+    assert(tkmalloc_quick_stats(&after) == 0);
+    assert(after.consolidations > before.consolidations);
+    assert(after.consolidated_chunks > before.consolidated_chunks);
+}
+
+int main(void){
+    if (CHUNK <= SIZE_CLASS_MAX) {
+        // a table with classes up to QUICK_MAX_SIZE leaves the quick lists nothing the cache doesn't take first
+        printf("[*] no chunk size between the size classes and the quick lists, skipping\n");
+        printf("OK: all tests passed ✅\n");
+        return 0;
+    }
+
+    printf("[*] test_reuse_without_merge...\n");
+    test_reuse_without_merge();
+
+    printf("[*] test_no_merge_while_bump_has_room...\n");
+    test_no_merge_while_bump_has_room();
+
+    printf("[*] test_consolidation...\n");
+    test_consolidation();
+
+    printf("OK: all tests passed ✅\n");
+
+    return 0;
+}
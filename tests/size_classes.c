@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "../src/chunk.h"
+
+/* Tests for the cache size classes: whichever table the library was built with (see tools/gen_size_classes) */
+
+static size_t chunk_size_of(void *p) {
+    // through an integer, so the compiler doesn't flag reading in front of a malloc'd object
+    return chunk_get_size((void *)((uintptr_t)p - sizeof(chunk_prefix_t)));
+}
+
+static void test_table(void) {
+    assert(SIZE_CLASS_COUNT >= 1 && SIZE_CLASS_COUNT <= 64);
+    assert(g_size_class_size[SIZE_CLASS_COUNT - 1] == SIZE_CLASS_MAX);
+
+    for (int c = 1; c < SIZE_CLASS_COUNT; ++c) {
+        assert(g_size_class_size[c] % 16 == 0);
+        assert(g_size_class_size[c] > g_size_class_size[c - 1]);
+    }
+
+    for (size_t i = 0; i <= SIZE_CLASS_MAX / 16; ++i) {
+        int ceil = g_size_class_ceil[i];
+        int floor = g_size_class_floor[i];
+        assert(g_size_class_size[ceil] >= i * 16);
+        assert(ceil == 0 || g_size_class_size[ceil - 1] < i * 16);
+        if (floor != SIZE_CLASS_NONE) {
+            assert(g_size_class_size[floor] <= i * 16);
+            assert(floor == SIZE_CLASS_COUNT - 1 || g_size_class_size[floor + 1] > i * 16);
+        }
+    }
+}
+
+static void test_rounding(void) {
+    for (size_t size = 1; size + 16 <= SIZE_CLASS_MAX; size += 7) {
+        void *p = malloc(size);
+        assert(p);
+        memset(p, 0xab, size);
+
+        // a chunk holds at least its class, so the cache can hand it to any request of that class
+        size_t csz = chunk_size_of(p);
+        size_t need = chunk_need_total(size);
+        assert(csz >= need);
+        assert(g_size_class_size[g_size_class_floor[csz / 16]] == need);
+        free(p);
+    }
+}
+
+static void test_reuse_within_class(void) {
+    for (int c = 1; c < SIZE_CLASS_COUNT; ++c) {
+        size_t lo = g_size_class_size[c - 1] + 1 - sizeof(chunk_prefix_t);   // smallest request of class c
+        size_t hi = g_size_class_size[c] - sizeof(chunk_prefix_t);           // largest
+
+        void *p = malloc(hi);
+        assert(p);
+        free(p);
+
+        void *q = malloc(lo);
+        assert(q == p);     // straight back out of the cache
+        free(q);
+    }
+}
+
+int main(void){
+    printf("[*] test_table...\n");
+    test_table();
+
+    printf("[*] test_rounding...\n");
+    test_rounding();
+
+    printf("[*] test_reuse_within_class...\n");
+    test_reuse_within_class();
+
+    printf("OK: all tests passed ✅\n");
+
+    return 0;
+}
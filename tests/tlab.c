@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../src/malloc.h"
+#include "../src/tlab.h"
+
+/* Tests for thread-local allocation buffers: chunks carved without the lock stay intact when other threads free
+ * their neighbors, a thread's unused slice goes back to the arena when it exits, and a used-up slice doesn't
+ * pin its heap. The last one needs frees to reach the heaps, so the test re-executes itself without caches
+ * and quick lists. */
+
+enum { THREADS = 4, ROUNDS = 20000, SLOTS = 256 };
+
+static void *g_handoff[THREADS][SLOTS];     // blocks a thread leaves for its right neighbor to free
+static pthread_mutex_t g_handoff_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t g_barrier;
+
+static size_t block_size(unsigned r) {
+    // mostly cacheable sizes, some mid-size ones that bypass the caches and coalesce next to the buffer
+    return (r % 8 == 0) ? 1100 + r % 6000 : 16 + r % 900;
+}
+
+static void fill(unsigned char *p, size_t n, unsigned char tag) {
+    p[0] = tag;
+    p[n / 2] = tag;
+    p[n - 1] = tag;
+}
+
+static void check(const unsigned char *p, size_t n, unsigned char tag) {
+    assert(p[0] == tag && p[n / 2] == tag && p[n - 1] == tag);
+}
+
+typedef struct { unsigned char *p; size_t n; } block_t;
+
+static void *churn(void *arg) {
+    int id = (int)(long)arg;
+    unsigned r = 1234567u * (unsigned)(id + 1);
+    block_t live[SLOTS] = { { NULL, 0 } };
+
+    for (int i = 0; i < ROUNDS; ++i) {
+        r = r * 1103515245u + 12345u;
+        int s = (int)((r >> 8) % SLOTS);
+
+        if (live[s].p) {
+            check(live[s].p, live[s].n, (unsigned char)s);
+
+            // every other block is freed by another thread, racing with its owner carving from the next slice bytes
+            pthread_mutex_lock(&g_handoff_lock);
+            void *old = g_handoff[(id + 1) % THREADS][s];
+            g_handoff[(id + 1) % THREADS][s] = (s & 1) ? live[s].p : NULL;
+            pthread_mutex_unlock(&g_handoff_lock);
+
+            if (!(s & 1)) free(live[s].p);
+            free(old);
+        }
+
+        live[s].n = block_size(r >> 16);
+        live[s].p = malloc(live[s].n);
+        assert(live[s].p);
+        fill(live[s].p, live[s].n, (unsigned char)s);
+    }
+
+    for (int s = 0; s < SLOTS; ++s) {
+        if (live[s].p) check(live[s].p, live[s].n, (unsigned char)s);
+        free(live[s].p);
+    }
+    return NULL;
+}
+
+static void test_cross_thread_frees(void) {
+    pthread_t t[THREADS];
+
+    for (int i = 0; i < THREADS; ++i) pthread_create(&t[i], NULL, churn, (void *)(long)i);
+    for (int i = 0; i < THREADS; ++i) pthread_join(t[i], NULL);
+
+    for (int i = 0; i < THREADS; ++i) {
+        for (int s = 0; s < SLOTS; ++s) free(g_handoff[i][s]);
+    }
+}
+
+static void *hold_slice(void *arg) {
+    (void)arg;
+    enum { N = 4 };
+
+    // these outlive the thread, so only the untouched rest of its slice can come back;
+    // a size nothing else uses, so a per-CPU cache can't serve it
+    for (int i = 0; i < N; ++i) assert(malloc(1000));
+
+    pthread_barrier_wait(&g_barrier);   // hold on until main has measured
+    pthread_barrier_wait(&g_barrier);
+    return NULL;
+}
+
+static void test_retired_on_exit(void) {
+    tkmalloc_heap_stats_t during, after;
+    pthread_t t;
+
+    pthread_barrier_init(&g_barrier, NULL, 2);
+    pthread_create(&t, NULL, hold_slice, NULL);
+    pthread_barrier_wait(&g_barrier);
+    assert(tkmalloc_heap_stats(&during) == 0);
+
+    pthread_barrier_wait(&g_barrier);
+    pthread_join(t, NULL);
+    pthread_barrier_destroy(&g_barrier);
+
+    // the thread carved about 4 KiB of a 16 KiB slice
+    assert(tkmalloc_heap_stats(&after) == 0);
+    assert(during.used_bytes >= after.used_bytes + 8 * 1024);
+}
+
+static uint64_t heap_count(void) {
+    tkmalloc_heap_stats_t st;
+    assert(tkmalloc_heap_stats(&st) == 0);
+    return st.heaps;
+}
+
+/* the largest class whose chunks fill a slice exactly, 0 if the size-class table has none */
+static size_t slice_filling_class(void) {
+    size_t best = 0;
+    for (int c = 0; c < SIZE_CLASS_COUNT; ++c) {
+        size_t sz = g_size_class_size[c];
+        if (TLAB_SLICE_SIZE % sz == 0 && sz > best) best = sz;
+    }
+    return best;
+}
+
+static void *use_up_slice(void *arg) {
+    enum { FILLERS = 64, FILLER = 8 * 1024, MAX_CHUNKS = TLAB_SLICE_SIZE / 32 };
+    size_t chunk = *(size_t *)arg, sz = chunk - 16;
+    int slice_chunks = (int)(TLAB_SLICE_SIZE / chunk);
+    void *fill[FILLERS], *p[MAX_CHUNKS];
+    int nfill = 0;
+
+    // fill the heap we carve from with chunks too big for a slice, until a filler needs a heap of its own;
+    // freeing that one unmaps the new heap again and leaves less room than a slice where we were
+    uint64_t heaps = heap_count();
+    while (heap_count() == heaps) {
+        assert(nfill < FILLERS);
+        fill[nfill] = malloc(FILLER);
+        assert(fill[nfill]);
+        ++nfill;
+    }
+    free(fill[--nfill]);
+    assert(heap_count() == heaps);
+
+    // so the next slice maps a heap that holds nothing else; carve all of it
+    do {
+        p[0] = malloc(sz);
+        assert(p[0]);
+    } while (heap_count() == heaps);
+
+    for (int i = 1; i < slice_chunks; ++i) {
+        p[i] = malloc(sz);
+        assert((uint8_t *)p[i] == (uint8_t *)p[i - 1] + chunk);
+    }
+
+    // every chunk of the slice is back: its heap goes, while this thread still remembers carving from it
+    for (int i = 0; i < slice_chunks; ++i) free(p[i]);
+    assert(heap_count() == heaps);
+
+    free(malloc(sz));
+
+    for (int i = 0; i < nfill; ++i) free(fill[i]);
+    return NULL;    // and the slice isn't retired into the unmapped heap on the way out
+}
+
+static void test_used_up_slice(void) {
+    pthread_t t;
+    size_t chunk = slice_filling_class();
+
+    if (!chunk) {
+        printf("[*] no size class fills a slice exactly, skipping\n");
+        return;
+    }
+
+    pthread_create(&t, NULL, use_up_slice, &chunk);
+    pthread_join(t, NULL);
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+
+    if (!getenv("TKMALLOC_TEST_TLAB_STAGE")) {
+        if (!getenv("TKMALLOC_DISABLE_TLAB")) {
+            printf("[*] test_retired_on_exit...\n");
+            test_retired_on_exit();
+        }
+
+        printf("[*] test_cross_thread_frees...\n");
+        test_cross_thread_frees();
+
+        // stage 2: without caches and quick lists every free reaches the heaps
+        setenv("TKMALLOC_DISABLE_TCACHE", "1", 1);
+        setenv("TKMALLOC_DISABLE_QUICKLIST", "1", 1);
+        setenv("TKMALLOC_TEST_TLAB_STAGE", "no-cache", 1);
+        fflush(stdout);
+        execv("/proc/self/exe", argv);
+        perror("execv");
+        return 1;
+    }
+
+    if (!getenv("TKMALLOC_DISABLE_TLAB")) {
+        printf("[*] test_used_up_slice...\n");
+        test_used_up_slice();
+    }
+
+    printf("OK: all tests passed ✅\n");
+
+    return 0;
+}
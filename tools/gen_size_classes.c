@@ -0,0 +1,274 @@
+/*
+ * gen_size_classes: derive tkmalloc's cache size classes from an allocation profile.
+ *
+ * Input (a file or stdin), one allocation per line; blank lines and lines starting with '#' are skipped:
+ *     <size> [count]          e.g. a histogram, "24 1830"
+ *     <op> <size> [count]     e.g. a trace, "malloc 24"; any non-numeric prefix is skipped
+ *
+ * Request sizes are turned into chunk sizes exactly like chunk_need_total() does, then classes are picked
+ * by dynamic programming to minimize internal fragmentation (bytes lost rounding each chunk up to its class),
+ * weighted by how often each size occurs. With -w, the smallest class count whose waste stays under the
+ * given fraction is used, so a lumpy profile gets fewer, better placed bins.
+ *
+ * The output header replaces src/size_classes.h: `make clean && make SIZE_CLASSES=<header>`.
+ *
+ * usage: gen_size_classes [-k max_classes] [-m max_chunk] [-w waste] [-l] [-o out.h] [trace]
+ *     -k  at most this many classes, 1..64 (default 64, the number of cache bins)
+ *     -m  largest chunk size that gets a class, a multiple of 16 (default 1040)
+ *     -w  stop adding classes once waste / requested bytes drops below this (default 0: use all -k)
+ *     -l  ignore the trace and emit the linear 16-byte ladder, the built-in table
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#define MAX_CLASSES 64              // TCACHE_MAX_BINS
+#define MIN_CHUNK 32
+#define MAX_CHUNK_LIMIT 65536       // class ids and the lookup tables stay small
+#define PREFIX 16                   // sizeof(chunk_prefix_t)
+#define MIN_FREE 48                 // get_free_chunk_min_size()
+
+static size_t align16(size_t n) { return (n + 15) & ~(size_t)15; }
+
+/* mirrors chunk_need_total() before class rounding */
+static size_t need_total(size_t size) {
+    size_t n = align16(PREFIX + align16(size));
+    return n < MIN_FREE ? MIN_FREE : n;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-k max_classes] [-m max_chunk] [-w waste] [-l] [-o out.h] [trace]\n", prog);
+    exit(2);
+}
+
+/* weight[c / 16] += count for every chunk size c <= max_chunk in the trace; returns the number of lines used */
+static long read_profile(FILE *in, size_t max_chunk, double *weight) {
+    char line[512];
+    long used = 0;
+
+    while (fgets(line, sizeof(line), in)) {
+        char *p = line;
+        while (*p && isspace((unsigned char)*p)) p++;
+        if (*p == '\0' || *p == '#') continue;
+
+        // skip an op name or anything else in front of the first number
+        while (*p && !isdigit((unsigned char)*p)) p++;
+        if (*p == '\0') continue;
+
+        char *end;
+        unsigned long long size = strtoull(p, &end, 10);
+        double count = 1;
+
+        p = end;
+        while (*p == ' ' || *p == '\t' || *p == ',') p++;
+        if (isdigit((unsigned char)*p)) count = strtod(p, NULL);
+
+        if (size == 0) continue;
+        size_t c = need_total((size_t)size);
+        if (c > max_chunk) continue;    // served by the arena, not the cache
+
+        weight[c / 16] += count;
+        used++;
+    }
+
+    return used;
+}
+
+/*
+ * Sizes are in 16-byte steps 0..steps. A class at step i serves every size between the class below it and i.
+ * best[k][i]: least waste covering sizes 0..i with at most k classes, the largest being exactly i;
+ * from[k][i] is the class below it (-1 for none, -2 if k - 1 classes already did as well).
+ */
+static int solve(const double *weight, int steps, int k_max, double waste_goal, int *classes) {
+    int n = steps + 1;
+    double *w = calloc((size_t)n + 1, sizeof(double));     // prefix sums, w[i + 1] covers steps 0..i
+    double *ws = calloc((size_t)n + 1, sizeof(double));
+    double *best = malloc((size_t)(k_max + 1) * n * sizeof(double));
+    int *from = malloc((size_t)(k_max + 1) * n * sizeof(int));
+
+    if (!w || !ws || !best || !from) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < n; i++) {
+        w[i + 1] = w[i] + weight[i];
+        ws[i + 1] = ws[i] + weight[i] * i;
+    }
+
+    // bytes lost serving steps j+1..i with a class at step i
+    #define COST(j, i) (16.0 * ((double)(i) * (w[(i) + 1] - w[(j) + 1]) - (ws[(i) + 1] - ws[(j) + 1])))
+
+    double requested = 16.0 * ws[n];
+
+    for (int i = 0; i < n; i++) {
+        best[1 * n + i] = COST(-1, i);
+        from[1 * n + i] = -1;
+    }
+
+    int k_used = 1;
+    while (k_used < k_max && !(waste_goal > 0 && best[k_used * n + steps] <= waste_goal * requested)) {
+        int k = ++k_used;
+        for (int i = 0; i < n; i++) {
+            best[k * n + i] = best[(k - 1) * n + i];
+            from[k * n + i] = -2;
+            for (int j = 0; j < i; j++) {
+                double c = best[(k - 1) * n + j] + COST(j, i);
+                if (c < best[k * n + i]) {
+                    best[k * n + i] = c;
+                    from[k * n + i] = j;
+                }
+            }
+        }
+    }
+
+    #undef COST
+
+    // walk the choices back down from the top class
+    int count = 0;
+    for (int i = steps, k = k_used; i >= 0 && k >= 1; k--) {
+        int j = from[k * n + i];
+        if (j == -2) continue;
+        classes[count++] = i;
+        i = j;
+    }
+
+    for (int a = 0, b = count - 1; a < b; a++, b--) {
+        int t = classes[a];
+        classes[a] = classes[b];
+        classes[b] = t;
+    }
+
+    fprintf(stderr, "%d classes, %.2f%% internal fragmentation\n", count,
+            requested > 0 ? 100.0 * best[k_used * n + steps] / requested : 0.0);
+
+    free(w);
+    free(ws);
+    free(best);
+    free(from);
+    return count;
+}
+
+static void emit(FILE *out, const int *classes, int count, size_t max_chunk, const char *source) {
+    int steps = (int)(max_chunk / 16);
+
+    fprintf(out, "/* generated by tools/gen_size_classes from %s, do not edit */\n", source);
+    fprintf(out, "#ifndef TKMALLOC_SIZE_CLASSES_H\n#define TKMALLOC_SIZE_CLASSES_H\n\n#include <stdint.h>\n\n");
+    fprintf(out, "#define SIZE_CLASS_COUNT %d\n", count);
+    fprintf(out, "#define SIZE_CLASS_MAX %zu      // largest chunk size with a class\n", max_chunk);
+    fprintf(out, "#define SIZE_CLASS_NONE 255\n\n");
+
+    fprintf(out, "/* chunk size of each class */\nstatic const uint32_t g_size_class_size[SIZE_CLASS_COUNT] = {");
+    for (int c = 0; c < count; c++) fprintf(out, "%s%s%d", c ? "," : "", c % 12 ? " " : "\n    ", classes[c] * 16);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "/* chunk size / 16 -> smallest class that holds it, what malloc rounds up to */\n");
+    fprintf(out, "static const uint8_t g_size_class_ceil[SIZE_CLASS_MAX / 16 + 1] = {");
+    int c = 0;
+    for (int i = 0; i <= steps; i++) {
+        while (classes[c] < i) c++;
+        fprintf(out, "%s%s%d", i ? "," : "", i % 16 ? " " : "\n    ", c);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "/* chunk size / 16 -> largest class it can serve, what free files it under; SIZE_CLASS_NONE below the first */\n");
+    fprintf(out, "static const uint8_t g_size_class_floor[SIZE_CLASS_MAX / 16 + 1] = {");
+    c = -1;
+    for (int i = 0; i <= steps; i++) {
+        while (c + 1 < count && classes[c + 1] <= i) c++;
+        fprintf(out, "%s%s%d", i ? "," : "", i % 16 ? " " : "\n    ", c < 0 ? 255 : c);
+    }
+    fprintf(out, "\n};\n\n#endif\n");
+}
+
+int main(int argc, char **argv) {
+    int k_max = MAX_CLASSES;
+    size_t max_chunk = 1040;
+    double waste_goal = 0;
+    int linear = 0;
+    const char *out_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "k:m:w:lo:")) != -1) {
+        switch (opt) {
+            case 'k': k_max = atoi(optarg); break;
+            case 'm': max_chunk = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'w': waste_goal = strtod(optarg, NULL); break;
+            case 'l': linear = 1; break;
+            case 'o': out_path = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if (k_max < 1 || k_max > MAX_CLASSES) {
+        fprintf(stderr, "-k must be between 1 and %d\n", MAX_CLASSES);
+        return 2;
+    }
+    if (max_chunk < MIN_CHUNK || max_chunk % 16 != 0 || max_chunk > MAX_CHUNK_LIMIT) {
+        fprintf(stderr, "-m must be a multiple of 16 between %d and %d\n", MIN_CHUNK, MAX_CHUNK_LIMIT);
+        return 2;
+    }
+
+    int steps = (int)(max_chunk / 16);
+    int classes[MAX_CLASSES];
+    int count;
+    const char *source;
+
+    if (linear) {
+        // 32, 48, ... in 16-byte steps: the historical need_total / 16 - 2 bins
+        count = 0;
+        for (int i = MIN_CHUNK / 16; i <= steps && count < k_max; i++) classes[count++] = i;
+        if (classes[count - 1] != steps) {
+            fprintf(stderr, "-l with -k %d covers only up to %d bytes, lower -m\n", k_max, classes[count - 1] * 16);
+            return 2;
+        }
+        source = "the linear 16-byte ladder (-l)";
+    }
+    else {
+        FILE *in = stdin;
+        source = "stdin";
+        if (optind < argc) {
+            source = argv[optind];
+            in = fopen(source, "r");
+            if (!in) {
+                perror(source);
+                return 1;
+            }
+        }
+
+        double *weight = calloc((size_t)steps + 1, sizeof(double));
+        if (!weight) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        long used = read_profile(in, max_chunk, weight);
+        if (in != stdin) fclose(in);
+
+        if (used == 0) {
+            fprintf(stderr, "no allocations of at most %zu bytes in %s\n", max_chunk, source);
+            return 1;
+        }
+
+        count = solve(weight, steps, k_max, waste_goal, classes);
+        free(weight);
+    }
+
+    FILE *out = stdout;
+    if (out_path) {
+        out = fopen(out_path, "w");
+        if (!out) {
+            perror(out_path);
+            return 1;
+        }
+    }
+
+    emit(out, classes, count, max_chunk, source);
+
+    if (out != stdout) fclose(out);
+    return 0;
+}